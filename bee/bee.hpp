@@ -40,7 +40,7 @@ Defer_Scope<F> defer_scope_new(F function)
     return Defer_Scope<F>{function};
 }
 
-#define Macro_Concat_(X, Y) x##y
+#define Macro_Concat_(X, Y) X##Y
 #define Macro_Concat(X, Y) Macro_Concat_(X, Y)
 #define defer(Code)                                                   \
     auto Macro_Concat(_defer_, __COUNTER__) = defer_scope_new([&]() { \
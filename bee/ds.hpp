@@ -56,6 +56,11 @@ struct Arena
         Arena_Bounds_Check(index);
         return data[index];
     }
+    const T &operator[](size_t index) const
+    {
+        Arena_Bounds_Check(index);
+        return data[index];
+    }
 
     T *at(size_t index)
     {
@@ -121,7 +126,7 @@ struct View
     View(T *begin, T *end) : data(begin), len(end - begin) {}
 };
 
-#define Vec_Grow(X) (X > 0 ? X * 2 : 1)
+#define Vec_Grow(X) ((X) > 0 ? (X) * 2 : 1)
 template <typename T>
 struct Vec
 {
@@ -151,8 +156,8 @@ struct Vec
 
     void deinit()
     {
-        Assert(data != NULL, "vec data is uninitialized");
         delete[] data;
+        data = NULL, len = 0, cap = 0;
     }
 
     T *begin() const
@@ -190,7 +195,7 @@ struct Vec
             reserve(Vec_Grow(cap + 1));
         return (data[len++] = x);
     }
-    T &pop(T element)
+    T pop()
     {
         Assert(len != 0, "vec is empty");
         return data[--len];
@@ -202,7 +207,7 @@ struct Vec
         if (len + concat_len >= cap) {
             reserve(Vec_Grow(cap + concat_len));
         }
-        memcpy(&data[len], concat_begin, concat_len);
+        memcpy(&data[len], concat_begin, concat_len * sizeof(T));
         len += concat_len;
     }
 
@@ -233,8 +238,187 @@ Vec<T> new_vec(size_t init_cap = 0)
     return vec;
 }
 
+// Growable arena with stable addresses, items are pushed into blocks that
+// double in size and never move. Block k holds 'first << k' items so an
+// index is found without walking the blocks.
+template <typename T>
+struct Block_Arena
+{
+    Vec<T *> blocks;
+    size_t len;
+    size_t cap;
+    size_t first;
+
+    T *push(T x)
+    {
+        if (len == cap) {
+            size_t size = first << blocks.len;
+            blocks.push(new T[size]{});
+            cap += size;
+        }
+        T *item = slot(len++);
+        *item = x;
+        return item;
+    }
+
+    bool empty() const
+    {
+        return len == 0;
+    }
+
+    T *slot(size_t index) const
+    {
+        size_t k = 63 - __builtin_clzll(index / first + 1);
+        return &blocks.data[k][index - first * ((1ull << k) - 1)];
+    }
+
+    T *at(size_t index) const
+    {
+        if (index >= len)
+            return NULL;
+        return slot(index);
+    }
+
+#define Block_Arena_Bounds_Check(index) \
+    Assert(index < len, "arena index out of bounds (%zu with arena[%zu])", index, len);
+
+    T &operator[](size_t index) const
+    {
+        Block_Arena_Bounds_Check(index);
+        return *slot(index);
+    }
+#undef Block_Arena_Bounds_Check
+
+    void deinit()
+    {
+        for (size_t i = 0; i < blocks.len; i++)
+            delete[] blocks.data[i];
+        blocks.deinit();
+        len = cap = 0;
+    }
+};
+
+template <typename T>
+Block_Arena<T> new_block_arena(size_t first = 8)
+{
+    Block_Arena<T> arena = {};
+    arena.first = Max(first, (size_t)1);
+    return arena;
+}
+
+// Arena of one block holding the 'len' items allocated by new[], it takes ownership of them
+template <typename T>
+Block_Arena<T> adopt_block_arena(T *items, size_t len)
+{
+    Block_Arena<T> arena = new_block_arena<T>(len);
+    arena.blocks = new_vec<T *>(1);
+    arena.blocks.push(items);
+    arena.len = arena.cap = len;
+    return arena;
+}
+
+// Fixed size cells out of a Block_Arena, released cells are reused before the
+// arena grows and deinit() frees every cell at once
+template <typename T>
+struct Pool
+{
+    Block_Arena<T> cells;
+    Vec<T *> free;
+
+    T *alloc(T x)
+    {
+        if (free.empty())
+            return cells.push(x);
+        T *cell = free.pop();
+        *cell = x;
+        return cell;
+    }
+
+    void release(T *cell)
+    {
+        free.push(cell);
+    }
+
+    size_t live() const
+    {
+        return cells.len - free.len;
+    }
+
+    void deinit()
+    {
+        cells.deinit();
+        free.deinit();
+    }
+};
+
+template <typename T>
+Pool<T> new_pool(size_t first = 64)
+{
+    Pool<T> pool = {};
+    pool.cells = new_block_arena<T>(first);
+    return pool;
+}
+
 const size_t npos = (size_t)-1;
 
+// Sparse set of integers in [0, cap), constant time insert, lookup and clear
+// from: https://research.swtch.com/sparse
+struct Sparse_Set
+{
+    u32 *dense;
+    u32 *sparse;
+    u32 len;
+    u32 cap;
+
+    typedef u32 *iterator;
+
+    u32 *begin() const
+    {
+        return &dense[0];
+    }
+    u32 *end() const
+    {
+        return &dense[len];
+    }
+
+    bool has(u32 x) const
+    {
+        Assert(x < cap, "sparse set value out of bounds (%u with set[%u])", x, cap);
+        u32 index = sparse[x];
+        return index < len and dense[index] == x;
+    }
+
+    bool insert(u32 x)
+    {
+        if (has(x))
+            return false;
+        sparse[x] = len;
+        dense[len++] = x;
+        return true;
+    }
+
+    void clear()
+    {
+        len = 0;
+    }
+
+    bool empty() const
+    {
+        return len == 0;
+    }
+
+    void deinit()
+    {
+        delete[] dense;
+        delete[] sparse;
+    }
+};
+
+inline Sparse_Set new_sparse_set(u32 cap)
+{
+    return Sparse_Set{new u32[cap](), new u32[cap](), 0, cap};
+}
+
 struct string
 {
     const char *data;
@@ -397,6 +581,68 @@ struct string
     }
 };
 
+// 256 bits membership set of bytes, a lookup is one load and one bit test
+struct Byte_Set
+{
+    u64 bits[4];
+
+    constexpr bool has(u8 c) const
+    {
+        return bits[c >> 6] >> (c & 63) & 1;
+    }
+
+    constexpr void insert(u8 c)
+    {
+        bits[c >> 6] |= (u64)1 << (c & 63);
+    }
+
+    constexpr void insert(u8 min, u8 max)
+    {
+        for (u32 c = min; c <= max; c++)
+            insert(c);
+    }
+
+    constexpr void merge(Byte_Set set)
+    {
+        for (size_t i = 0; i < Array_Size(bits); i++)
+            bits[i] |= set.bits[i];
+    }
+
+    u32 count() const
+    {
+        u32 n = 0;
+        for (u64 word : bits)
+            n += __builtin_popcountll(word);
+        return n;
+    }
+
+    // first member at or after 'c', 256 when there is none
+    u32 next(u32 c) const
+    {
+        for (; c < 256 and !has(c); c++) {
+        }
+        return c;
+    }
+
+    bool operator==(const Byte_Set &set) const
+    {
+        return !memcmp(bits, set.bits, sizeof(bits));
+    }
+};
+
+inline Byte_Set new_byte_set(string s)
+{
+    Byte_Set set = {};
+    for (char c : s)
+        set.insert(c);
+    return set;
+}
+
+inline size_t hash(u64 key)
+{
+    return key * 0x9e3779b97f4a7c15ull >> 32;
+}
+
 // from: https://aozturk.medium.com/simple-hash-map-hash-table-implementation-in-c-931965904250
 #define Hash_Map_Grow(X) (X > 1 ? (X * X) : (2))
 template <typename K, typename V>
@@ -450,6 +696,7 @@ template <typename K, typename V>
 struct Hash_Map
 {
     Hash_Bucket<K, V> **table;
+    Pool<Hash_Bucket<K, V>> buckets;
     i64 bounds[2];
     size_t count;
     size_t cap;
@@ -467,7 +714,7 @@ struct Hash_Map
 
     size_t fwd_occupied_index(i64 i)
     {
-        for (; i < cap and !table[i]; i++) {
+        for (; i < (i64)cap and !table[i]; i++) {
         }
         return i;
     }
@@ -497,10 +744,10 @@ struct Hash_Map
         Hash_Bucket<K, V> *prev = NULL;
         Hash_Bucket<K, V> *bucket = table[index];
 
-        for (; bucket != NULL and bucket->key != key; prev = bucket)
-            bucket = bucket->next;
+        for (; bucket != NULL and bucket->key != key; bucket = bucket->next)
+            prev = bucket;
         if (!bucket) {
-            bucket = new Hash_Bucket<K, V>{key, value, NULL};
+            bucket = buckets.alloc(Hash_Bucket<K, V>{key, value, NULL});
             count++;
             if (!prev) {
                 table[index] = bucket;
@@ -520,20 +767,22 @@ struct Hash_Map
         Hash_Bucket<K, V> *prev = NULL;
         Hash_Bucket<K, V> *bucket = table[index];
 
-        for (; bucket != NULL and bucket->key != key; prev = bucket)
-            bucket = bucket->next;
+        for (; bucket != NULL and bucket->key != key; bucket = bucket->next)
+            prev = bucket;
         if (bucket != NULL) {
             auto copy = *bucket;
             count--;
+            // the head goes out of the table before its cell is reused
             if (prev != NULL) {
                 prev->next = bucket->next;
+            } else {
+                table[index] = bucket->next;
             }
-            delete bucket;
-            bucket = NULL;
+            buckets.release(bucket);
             if (!prev) {
                 when_table_is_modified();
             }
-            return bucket;
+            return copy;
         }
         return {};
     }
@@ -558,7 +807,7 @@ struct Hash_Map
     V *at(K key)
     {
         auto bucket = bucket_at(key);
-        return bucket ? bucket->key : NULL;
+        return bucket ? &bucket->value : NULL;
     }
 
     bool has(K key)
@@ -570,8 +819,16 @@ struct Hash_Map
     {
         auto hash_map = new_hash_map<K, V>(count);
         hash_map.merge(this);
+        deinit();
         *this = hash_map;
     }
+
+    void deinit()
+    {
+        delete[] table;
+        buckets.deinit();
+        table = NULL, count = cap = 0;
+    }
 };
 
 template <typename K, typename V>
@@ -596,6 +853,7 @@ Hash_Map<K, V> new_hash_map(size_t cap = 0)
 {
     Hash_Map<K, V> hash_map = {};
     hash_map.table = new Hash_Bucket<K, V> *[cap]();
+    hash_map.buckets = new_pool<Hash_Bucket<K, V>>(Max(cap, (size_t)8));
     hash_map.cap = cap;
     return hash_map;
 }
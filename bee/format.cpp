@@ -7,11 +7,11 @@ char *write_itoa(char *it, string alphabet, i32 base, u64 x)
 {
     char *end = it + 1;
 
-    for (auto n = Abs(x) / base; n >= base; end++)
+    for (u64 n = x / base; n > 0; end++)
         n /= base;
-    for (char *w = end; w != it - 1; w--) {
-	*w = alphabet[size_t(x % base)];
-	x /= base;
+    for (char *w = end - 1; w >= it; w--) {
+        *w = alphabet[size_t(x % base)];
+        x /= base;
     }
 
     return end;
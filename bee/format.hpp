@@ -426,7 +426,7 @@ void format(Context *context, Device *dev, Fmt_Int auto v)
         *it++ = case_hash[1];
     }
 
-    it = write_itoa(it, Number_Alphabet[context->base_upcase], context->base, v);
+    it = write_itoa(it, Number_Alphabet[context->base_upcase], context->base, v < 0 ? -(u64)v : (u64)v);
     dev->print_argument(context, string{buf, it});
 }
 
@@ -460,8 +460,17 @@ void format(Context *context, Device *dev, Fmt_Float auto v)
     if (prec != 0) {
         // todo! check buffer overflow
         *it++ = '.';
-        u64 frac = (v - whole) * pow(prec, 10);
+        u64 frac = (v - whole) * pow(10, prec);
+        char *digits = it;
         it = write_itoa(it, Number_Alphabet[0], 10, frac);
+
+        // leading zeros of the fraction
+        i64 len = it - digits;
+        if (len < prec) {
+            memmove(&digits[prec - len], digits, len);
+            memset(digits, '0', prec - len);
+            it = &digits[prec];
+        }
     }
 
     dev->print_argument(context, string{buf, it});
@@ -1,8 +1,10 @@
 #include "regex.hpp"
+#include "thread_pool.hpp"
 
 namespace bee::regex
 {
 
+// Lookarounds are run by the backtracker
 u64 State::submit(string expr, u64 n) const
 {
     if (option != Regex_Eps and n >= expr.len)
@@ -11,6 +13,8 @@ u64 State::submit(string expr, u64 n) const
     switch (option) {
     case Regex_Monostate:
     case Regex_None:
+    case Regex_Not:
+    case Regex_Dash:
         return npos;
 
     case Regex_Eps:
@@ -19,12 +23,6 @@ u64 State::submit(string expr, u64 n) const
     case Regex_Any:
         return n + 1;
 
-    case Regex_Not:
-        return sequence->submit(expr, n) != npos ? npos : n + 1;
-
-    case Regex_Dash:
-        return sequence->submit(expr, n) != npos ? n : npos;
-
     case Regex_Str: {
         if (expr.len < n + str.len)
             return npos;
@@ -33,160 +31,276 @@ u64 State::submit(string expr, u64 n) const
     }
 
     case Regex_Set:
-        return str.index(expr[n]) != npos ? n + 1 : npos;
-
     case Regex_Scope:
-        return range[0] <= expr[n] and expr[n] <= range[1] ? n + 1 : npos;
+        return set.has(expr[n]) ? n + 1 : npos;
     }
 
     return npos;
 }
 
-Node_Set *node_set_insert(Node_Set *set, Node *node)
+// The edge goes after the last one in O(1), a wide alternation is built in
+// time linear to its branches
+void Node::push_edge(Node *node, Node_Set_Pool *pool)
 {
-    for (auto it = set; it != NULL; it = it->next) {
-        if (it->node == node)
-            return set;
-    }
-
-    if (!set) {
-        set = new Node_Set{node, NULL};
-    } else {
-        auto it = set;
-        auto at = it;
+    auto insertion = pool->alloc(Node_Set{node, NULL});
+    if (!edges)
+        edges = insertion;
+    else
+        last_edge->next = insertion;
+    last_edge = insertion;
+}
 
-        while (it != NULL and it->node->id < node->id) {
-            at = it;
-            it = it->next;
-        }
+bool Memo::has(const Node *node, u64 n) const
+{
+    if (n >= clean)
+        return false;
+    u64 bit = n * nodes + node->id;
+    return bits[bit / 64] >> (bit % 64) & 1;
+}
 
-        auto insertion = new Node_Set{node, at->next};
-        at->next = insertion;
+// The rows up to 'n' are cleared first, the bits past them in the last word
+// belong to rows not set yet
+void Memo::insert(const Node *node, u64 n)
+{
+    if (n >= clean) {
+        u64 begin = clean * nodes;
+        u64 word = begin / 64;
+        u64 end = ((n + 1) * nodes + 63) / 64;
+        if (begin % 64)
+            bits[word++] &= ((u64)1 << (begin % 64)) - 1;
+        if (word < end)
+            memset(&bits[word], 0, (end - word) * sizeof(u64));
+        clean = n + 1;
     }
-    return set;
+    u64 bit = n * nodes + node->id;
+    bits[bit / 64] |= (u64)1 << (bit % 64);
 }
 
-void node_set_deinit(Node_Set *set)
+// First offset from 'n' where the single byte 'state' does not match
+u64 skip_state(const State &state, string expr, u64 n)
 {
-    Node_Set *previous;
-
-    while (set != NULL) {
-        previous = set;
-        set = set->next;
-        delete previous;
+    switch (state.option) {
+    case Regex_Any:
+        return expr.len;
+    case Regex_Str:
+        while (n < expr.len and expr.data[n] == state.str.data[0])
+            n++;
+        return n;
+    default:
+        while (n < expr.len and state.set.has(expr.data[n]))
+            n++;
+        return n;
     }
 }
 
-void Node::deinit()
+// Branch from 'from' whose literal starts at 'n', the branches past the
+// literal ones of the trie are all tried
+u64 next_branch(const Node *node, string expr, u64 n, u32 from)
 {
-    node_set_deinit(edges);
-    node_set_deinit(member_cache);
+    if (from >= node->trie->span)
+        return from;
+    u32 branch = node->trie->next(expr, n, from);
+    return branch != Trie_None ? branch : node->trie->span;
 }
 
-u64 Node::submit(string expr, u64 n) const
+void Backtracker::deinit()
 {
-    u64 match = state.submit(expr, n);
+    if (!scratch)
+        return;
+    scratch->frames.deinit();
+    scratch->bits.deinit();
+    delete scratch;
+}
 
-    if (match != npos) {
-        if (!has_edges() and match >= expr.len)
-            return match;
+// Memoization bounds the backtracker to O(nodes * len) when the bitmap fits
+// 'memo_size', returns NULL otherwise
+Memo *Backtracker::reset(string expr, Memo *memo) const
+{
+    size_t words = (nodes * (expr.len + 1) + 63) / 64;
+    scratch->frames.len = 0;
 
-        for (auto it = edges; it != NULL; it = it->next) {
-            u64 match_fwd = it->node->submit(expr, match);
-            if (match_fwd != npos)
-                return match_fwd;
-        }
+    if (words * sizeof(u64) > memo_size)
+        return NULL;
 
-        if (!has_edges())
-            return match;
-    }
+    Vec<u64> &bits = scratch->bits;
+    bits.reserve(words);
+    bits.len = words;
 
-    return npos;
+    *memo = {bits.data, nodes, 0};
+    return memo;
 }
 
-Node *Node::push(Node *node)
+u64 Backtracker::submit(string expr) const
 {
-    node->map_sequence_ids(end()->id + 1);
-    edges = node_set_insert(edges, node);
-    when_edges_are_modified();
-
-    return node;
+    Memo memo = {};
+    return run(head, expr, 0, reset(expr, &memo));
 }
 
-Node *Node::merge(Node *node)
+// A node fails at 'n' whatever the start of the run, so the memo of the
+// first start is kept by all the others and the search stays O(nodes * len)
+u64 Backtracker::search(string expr, u64 from, u64 end, u64 *begin, Memo *memo) const
 {
-    node->map_sequence_ids(end()->id + 1);
-    return concat(node);
+    for (u64 n = from; n <= end; n++) {
+        u64 match = run(head, expr, n, memo);
+        if (match != npos) {
+            *begin = n;
+            return match;
+        }
+    }
+    return npos;
 }
 
-Node *Node::concat(Node *node)
+// Frames above 'base' belong to this run, a lookaround runs one level deeper
+// on the same frames and leaves them as it found them. A frame is dropped as
+// it takes its last edge: past a leaf every failure ends in the match of the
+// leaf, the 'fallback', and without memo a failure only goes up, so a single
+// line as long as the input keeps a few frames
+u64 Backtracker::run(const Node *node, string expr, u64 n, Memo *memo) const
 {
-    auto members = make_members();
+    Vec<Backtrack_Frame> &frames = scratch->frames;
+    size_t base = frames.len;
+    u64 fallback = npos;
+
+    for (;;) {
+        if (node != NULL and (memo == NULL or !memo->has(node, n))) {
+            if (node->until) {
+                frames.push({node, n, skip_state(node->out[1]->state, expr, n), n});
+            } else {
+                u64 match = step(node->state, expr, n, memo);
+                if (match != npos and node->leaf and match >= expr.len) {
+                    frames.len = base;
+                    return match;
+                }
+                if (match != npos)
+                    frames.push({node, n, match, node->trie ? next_branch(node, expr, match, 0) : 0});
+                else if (memo != NULL)
+                    memo->insert(node, n);
+            }
+        }
+        node = NULL;
+
+        if (frames.len == base)
+            return fallback;
+        Backtrack_Frame &top = frames[frames.len - 1];
+
+        if (top.node->until) {
+            // 'b' can only start at one of its occurrences in the 'a' run or
+            // right after it, they are found with memchr or memmem
+            string str = top.node->out[0]->state.str;
+            u64 last = Min(top.match + str.len, expr.len);
+            if (top.next < last) {
+                string rest = expr.substr(top.next, last - top.next);
+                u64 index = str.len == 1 ? rest.index(str.data[0]) : rest.index(str);
+                if (index != npos and top.next + index <= top.match) {
+                    node = top.node->out[0], n = top.next + index;
+                    top.next = n + 1;
+                    continue;
+                }
+            }
+        } else if (top.next < top.node->out.len) {
+            node = top.node->out[top.next], n = top.match;
+            top.next = top.node->trie ? next_branch(top.node, expr, n, top.next + 1) : top.next + 1;
+            if (top.next == top.node->out.len and top.node->leaf)
+                fallback = top.match, frames.len = base;
+            else if (top.next == top.node->out.len and memo == NULL)
+                frames.len--;
+            continue;
+        } else if (top.node->leaf) {
+            u64 match = top.match;
+            frames.len = base;
+            return match;
+        }
 
-    for (auto it = members; it != NULL; it = it->next) {
-        if (!it->node->has_edges())
-            it->node->edges = node_set_insert(it->node->edges, node);
+        if (memo != NULL)
+            memo->insert(top.node, top.n);
+        frames.len--;
     }
-
-    when_edges_are_modified();
-    return node;
 }
 
-Node *Node::end()
+u64 Backtracker::step(const State &state, string expr, u64 n, Memo *memo) const
 {
-    auto members = make_members();
-    Node *node_end = this;
+    switch (state.option) {
+    case Regex_Not:
+        if (n >= expr.len)
+            return npos;
+        return run(state.sequence, expr, n, memo) != npos ? npos : n + 1;
 
-    for (auto it = members; it != NULL; it = it->next) {
-        node_end = node_end->id > it->node->id ? node_end : it->node;
+    case Regex_Dash:
+        if (n >= expr.len)
+            return npos;
+        return run(state.sequence, expr, n, memo) != npos ? n : npos;
+
+    default:
+        return state.submit(expr, n);
     }
-    return node_end;
 }
 
-Node *Node::max_edge() const
+Backtracker new_backtracker(const Node *head, size_t nodes, size_t memo_size)
 {
-    auto it = edges;
-    while (it->next != NULL)
-        it = it->next;
-
-    return it ? it->node : NULL;
+    auto scratch = new Backtrack_Scratch{new_vec<Backtrack_Frame>(), new_vec<u64>()};
+    return Backtracker{head, nodes, memo_size, scratch};
 }
 
-bool Node::has_edges() const
+// Every operator links its operands through their heads and leaves, the
+// graph is built in time linear to the pattern
+
+// 'node' becomes one more branch of the head
+Node *Node::push(Node *node, Node_Set_Pool *pool)
 {
-    return edges != NULL and max_edge()->id > id;
+    push_edge(node, pool);
+    if (leaf)
+        tails = last_tail = NULL;
+    leaf = false;
+    join_tails(node);
+
+    return node;
 }
 
-void Node::map_sequence_ids(u32 zero)
+// 'node' comes after the sequence, its leaves lead to it
+Node *Node::merge(Node *node, Node_Set_Pool *pool)
 {
-    auto members = make_members();
-    for (auto it = members; it != NULL; it = it->next) {
-        it->node->id += zero;
+    literals = false;
+    for (Node *it = tails; it != NULL; it = it->next_tail) {
+        it->push_edge(node, pool);
+        it->leaf = false;
     }
+    tails = last_tail = NULL;
+    join_tails(node);
+
+    return node;
 }
 
-Node_Set *seek_members(Node *node, Node_Set *set)
+// The leaves loop back to 'node' and stay leaves, the loop is linked right
+// after the first edge of a leaf and ahead of its older loops, a leaf that
+// already loops to 'node' has it in one of these two places
+Node *Node::concat(Node *node, Node_Set_Pool *pool)
 {
-    set = node_set_insert(set, node);
-
-    for (auto it = node->edges; it != NULL; it = it->next) {
-        if (it->node->id > node->id)
-            seek_members(it->node, set);
+    literals = false;
+    for (Node *it = tails; it != NULL; it = it->next_tail) {
+        Node_Set *first = it->edges;
+        if (!first) {
+            it->push_edge(node, pool);
+        } else if (first->node != node and (!first->next or first->next->node != node)) {
+            first->next = pool->alloc(Node_Set{node, first->next});
+            if (it->last_edge == first)
+                it->last_edge = first->next;
+        }
     }
-    return set;
+    return node;
 }
 
-Node_Set *Node::make_members()
+// The leaves of the sequence headed by 'node' become leaves of this one
+void Node::join_tails(Node *node)
 {
-    if (!member_cache)
-        member_cache = seek_members(this, member_cache);
-    return member_cache;
-}
+    if (!node->tails)
+        return;
 
-void Node::when_edges_are_modified()
-{
-    node_set_deinit(member_cache);
-    member_cache = NULL;
+    if (!tails)
+        tails = node->tails;
+    else
+        last_tail->next_tail = node->tails;
+    last_tail = node->last_tail;
+    node->tails = node->last_tail = NULL;
 }
 
 Node *Parser::parse()
@@ -194,13 +308,17 @@ Node *Parser::parse()
     for (token = source.begin(); token < source.end(); token++) {
         Node *sequence = parse_next_token();
         if (sequence != NULL)
-            sequences.push(sequence);
+            sequences->push(sequence);
+        else if (closed)
+            break;
     }
 
-    for (size_t i = 1; i < sequences.len; i++) {
-        sequences[0]->merge(sequences[i]);
+    for (size_t i = base + 1; i < sequences->len; i++) {
+        (*sequences)[base]->merge((*sequences)[i], sets);
     }
-    return !sequences.empty() ? sequences[0] : NULL;
+    Node *head = sequences->len > base ? (*sequences)[base] : NULL;
+    sequences->len = base;
+    return head;
 }
 
 Node *Parser::parse_next_token()
@@ -257,6 +375,10 @@ Node *Parser::parse_next_token()
         return parse_wave();
 
     case '}':
+        if (nested) {
+            closed = true;
+            return NULL;
+        }
         errorf("unmatched sequence brace, missing '{' token");
     case ']':
         errorf("unmatched scope brace, missing '[' token");
@@ -265,32 +387,6 @@ Node *Parser::parse_next_token()
     }
 }
 
-string Parser::parse_subsequence()
-{
-    i32 depth = 1;
-    const char *begin = token + 1;
-    const char *end = begin;
-
-    while (depth > 0 and end < source.end()) {
-        switch (*end) {
-        case '{':
-            depth++;
-            break;
-        case '}':
-            depth--;
-            break;
-        }
-        end++;
-    }
-
-    if (depth > 0) {
-        errorf("unmatched sequence brace, missing '}' token");
-    }
-
-    token = end - 1;
-    return string{begin, end - 1};
-}
-
 Binary Parser::parse_binary_op(char op)
 {
     return Binary{parse_pre_op(op), parse_post_op(op)};
@@ -298,10 +394,10 @@ Binary Parser::parse_binary_op(char op)
 
 Node *Parser::parse_pre_op(char op)
 {
-    if (sequences.empty()) {
+    if (sequences->len == base) {
         errorf("missing pre-operand for '%c' operator", op);
     }
-    return sequences.pop();
+    return sequences->pop();
 }
 
 Node *Parser::parse_post_op(char op)
@@ -314,11 +410,19 @@ Node *Parser::parse_post_op(char op)
     return sequence;
 }
 
-Node *Parser::parse_set(string set)
+Node *Parser::new_node(Option option)
 {
     auto node = arena->push(Node{});
-    node->state.option = Regex_Set;
-    node->state.str = set;
+    node->state.option = option;
+    node->leaf = true;
+    node->tails = node->last_tail = node;
+    return node;
+}
+
+Node *Parser::parse_set(string set)
+{
+    auto node = new_node(Regex_Set);
+    node->state.set = new_byte_set(set);
 
     return node;
 }
@@ -329,18 +433,16 @@ Node *Parser::parse_scope()
         errorf("scope does not match the format ('[' ^ '-' ^ ']')");
     }
 
-    auto node = arena->push(Node{});
-    node->state.option = Regex_Scope;
-    node->state.range[0] = token[1];
-    node->state.range[1] = token[3];
+    auto node = new_node(Regex_Scope);
+    node->state.set = {};
+    node->state.set.insert(token[1], token[3]);
     token = &token[4];
     return node;
 }
 
 Node *Parser::parse_any()
 {
-    auto node = arena->push(Node{});
-    node->state.option = Regex_Any;
+    auto node = new_node(Regex_Any);
     return node;
 }
 
@@ -352,30 +454,36 @@ Node *Parser::parse_str(char quote)
     if (end >= source.end()) {
         errorf("unmatched string quote, missing ending '%c' token", quote);
     }
-    auto node = arena->push(Node{});
-    node->state.option = Regex_Str;
+    auto node = new_node(Regex_Str);
     node->state.str = {begin, end};
     token = end;
     return node;
 }
 
+// The nested parser stops at the closing brace, every byte is read once
 Node *Parser::parse_sequence()
 {
-    return new_parser(parse_subsequence(), arena).parse();
+    Parser parser = new_parser({token + 1, source.end()}, arena, sets, sequences);
+    parser.nested = true;
+    Node *sequence = parser.parse();
+
+    if (parser.token >= source.end()) {
+        errorf("unmatched sequence brace, missing '}' token");
+    }
+    token = parser.token;
+    return sequence;
 }
 
 Node *Parser::parse_dash()
 {
-    auto node = arena->push(Node{});
-    node->state.option = Regex_Dash;
+    auto node = new_node(Regex_Dash);
     node->state.sequence = parse_post_op('/');
     return node;
 }
 
 Node *Parser::parse_not()
 {
-    auto node = arena->push(Node{});
-    node->state.option = Regex_Not;
+    auto node = new_node(Regex_Not);
     node->state.sequence = parse_post_op('!');
     return node;
 }
@@ -389,31 +497,86 @@ Node *Parser::parse_not()
 // x: none
 // >: edge
 
+// A leaf that consumes a literal or one byte of a set
+bool is_literal_leaf(Node *node)
+{
+    if (node->edges != NULL)
+        return false;
+
+    switch (node->state.option) {
+    case Regex_Str:
+        return node->state.str.len > 0;
+    case Regex_Set:
+    case Regex_Scope:
+        return true;
+    default:
+        return false;
+    }
+}
+
 Node *Parser::parse_or()
 {
     //   > a
     // $
     //   > b
     auto [a, b] = parse_binary_op('|');
-    auto sequence = arena->push(Node{});
-    sequence->state.option = Regex_Eps;
-    sequence->push(a);
-    sequence->push(b);
+    if (Node *set = parse_set_or(a, b))
+        return set;
+
+    // {'if'|'else'|'while'} is one fan-out of literals, not a chain
+    if (a->literals and is_literal_leaf(b)) {
+        a->push(b, sets);
+        return a;
+    }
+
+    auto sequence = new_node(Regex_Eps);
+    sequence->push(a, sets);
+    sequence->push(b, sets);
+    sequence->literals = is_literal_leaf(a) and is_literal_leaf(b);
 
     return sequence;
 }
 
+bool is_byte_set(Node *node)
+{
+    switch (node->state.option) {
+    case Regex_Set:
+    case Regex_Scope:
+        return node->edges == NULL;
+    case Regex_Str:
+        return node->edges == NULL and node->state.str.len == 1;
+    default:
+        return false;
+    }
+}
+
+Node *Parser::parse_set_or(Node *a, Node *b)
+{
+    // {'_'|a|[0-9]} each branch consumes one byte then joins, it is one set
+    if (!is_byte_set(a) or !is_byte_set(b))
+        return NULL;
+
+    Node *nodes[] = {a, b};
+    for (Node *node : nodes) {
+        if (node->state.option == Regex_Str) {
+            string str = node->state.str;
+            node->state.set = new_byte_set(str);
+        }
+        node->state.option = Regex_Set;
+    }
+    a->state.set.merge(b->state.set);
+    return a;
+}
+
 Node *Parser::parse_quest()
 {
     //   > o
     // $
     //   > $'
-    auto sequence = arena->push(Node{});
-    auto no = arena->push(Node{});
-    sequence->state.option = Regex_Eps;
-    sequence->merge(parse_pre_op('?'));
-    sequence->push(no);
-    no->state.option = Regex_Eps;
+    auto sequence = new_node(Regex_Eps);
+    auto no = new_node(Regex_Eps);
+    sequence->merge(parse_pre_op('?'), sets);
+    sequence->push(no, sets);
 
     return sequence;
 }
@@ -423,13 +586,11 @@ Node *Parser::parse_star()
     //   > o > $
     // $
     //   > $'
-    auto sequence = arena->push(Node{});
-    auto no = arena->push(Node{});
-    sequence->state.option = Regex_Eps;
-    sequence->merge(parse_pre_op('*'));
-    sequence->concat(sequence);
-    sequence->push(no);
-    no->state.option = Regex_Eps;
+    auto sequence = new_node(Regex_Eps);
+    auto no = new_node(Regex_Eps);
+    sequence->merge(parse_pre_op('*'), sets);
+    sequence->concat(sequence, sets);
+    sequence->push(no, sets);
 
     return sequence;
 }
@@ -438,7 +599,7 @@ Node *Parser::parse_plus()
 {
     // o > $ > o
     auto sequence = parse_pre_op('+');
-    return sequence->concat(sequence);
+    return sequence->concat(sequence, sets);
 }
 
 Node *Parser::parse_wave()
@@ -448,20 +609,29 @@ Node *Parser::parse_wave()
     //   > a > $
     //       > x
     auto [a, b] = parse_binary_op('~');
-    auto sequence = arena->push(Node{});
-    auto none = arena->push(Node{});
-    sequence->state.option = Regex_Eps;
-    sequence->push(b);
-    sequence->push(a)->concat(sequence);
-    a->merge(none);
-    none->state.option = Regex_None;
+    auto sequence = new_node(Regex_Eps);
+    auto none = new_node(Regex_None);
+
+    bool byte = is_byte_set(a) or (a->state.option == Regex_Any and a->edges == NULL);
+    bool literal = b->state.option == Regex_Str and b->edges == NULL and b->state.str.len > 0;
+    sequence->until = byte and literal and !b->state.str.has('\0');
+
+    a->concat(sequence, sets);
+    a->merge(none, sets);
+    sequence->push(b, sets);
+    sequence->push(a, sets);
 
     return sequence;
 }
 
-Parser new_parser(string source, Node_Arena *arena)
+Parser new_parser(string source, Node_Arena *arena, Node_Set_Pool *sets, Vec<Node *> *sequences)
 {
-    return Parser{source, &source[0], arena, {}};
+    return Parser{source, source.data, arena, sets, sequences, sequences->len, false, false};
+}
+
+Config new_config(Engine engine)
+{
+    return Config{engine, Lazy_Dfa_Cache_Size, Memo_Size, Pass_All};
 }
 
 Match new_match(string expr, u64 index)
@@ -482,28 +652,569 @@ Match new_match(string expr, u64 index)
 
 void Regex::deinit()
 {
-    for (auto it = arena.begin(); it != arena.end(); it++) {
-        it->deinit();
+    arena.deinit();
+    edges.deinit();
+    strings.deinit();
+    prog.deinit();
+    reverse.deinit();
+    dfa.deinit();
+    glushkov.deinit();
+    for (size_t i = 0; i < tries.len; i++)
+        tries[i].deinit();
+    tries.deinit();
+}
+
+// Moves the nodes reached from the head into one block of the exact size and
+// packs their edges into one array, the nodes are renumbered in slot order.
+// The nodes the parser and simplify() left behind are dropped, the edge lists
+// of the parser are not used anymore and are freed with their pool
+void Regex::freeze()
+{
+    Vec<u8> reached = new_vec<u8>(arena.len);
+    Vec<Node *> stack = new_vec<Node *>(16);
+    defer(reached.deinit(); stack.deinit());
+    reached.reserve_with(arena.len, false);
+    reached.len = arena.len;
+
+    for (size_t i = 0; i < arena.len; i++)
+        arena[i].id = i;
+    auto reach = [&](Node *node) {
+        if (!reached[node->id])
+            reached[node->id] = true, stack.push(node);
+    };
+    if (node_head != NULL)
+        reach(node_head);
+    while (!stack.empty()) {
+        Node *node = stack.pop();
+        for (auto it = node->edges; it != NULL; it = it->next)
+            reach(it->node);
+        if (node->state.option == Regex_Not or node->state.option == Regex_Dash)
+            reach(node->state.sequence);
     }
+
+    size_t count = 0;
+    size_t len = 0;
+    for (size_t i = 0; i < arena.len; i++) {
+        if (!reached[i])
+            continue;
+        arena[i].id = count++;
+        for (auto it = arena[i].edges; it != NULL; it = it->next)
+            len++;
+    }
+
+    Node *nodes = new Node[count]{};
+    edges = new_vec<Node *>(len + 1);
+    for (size_t i = 0; i < arena.len; i++) {
+        if (!reached[i])
+            continue;
+        Node *node = &nodes[arena[i].id];
+        Node **begin = edges.end();
+
+        *node = arena[i];
+        for (auto it = node->edges; it != NULL; it = it->next)
+            edges.push(&nodes[it->node->id]);
+        if (node->state.option == Regex_Not or node->state.option == Regex_Dash)
+            node->state.sequence = &nodes[node->state.sequence->id];
+        node->out = View<Node *>{begin, edges.end()};
+        node->edges = node->last_edge = NULL;
+        node->tails = node->last_tail = node->next_tail = NULL;
+    }
+
+    if (node_head != NULL)
+        node_head = &nodes[node_head->id];
+    arena.deinit();
+    arena = adopt_block_arena(nodes, count);
 }
 
-Match Regex::match(string expr) const
+Match Regex::match(string expr, Scratch *scratch) const
 {
     if (!node_head)
         return new_match(expr, npos);
-    return new_match(expr, node_head->submit(expr, 0));
+    if (scratch == NULL)
+        scratch = thread_scratch(this);
+
+    switch (engine) {
+    case Engine_Backtrack:
+        return new_match(expr, backtrack(expr, scratch));
+    case Engine_Dfa:
+        return new_match(expr, dfa.submit(expr));
+    case Engine_Lazy_Dfa:
+        return new_match(expr, scratch->lazy_dfa.submit(expr));
+    case Engine_Pike:
+        return new_match(expr, scratch->pike_vm.submit(expr));
+    }
+    return new_match(expr, npos);
+}
+
+// Leftmost match, the automata search in one pass from the first start the
+// prefilter allows. The backtracker only runs at the starts it allows, or at
+// the keys the trie of the head finds, with one memo for the whole haystack.
+u64 Regex::search_backtrack(string haystack, u64 from, u64 end, u64 *begin, Scratch *scratch) const
+{
+    if (glushkov.offsets.len)
+        return glushkov.search(haystack, from, begin, &scratch->lives);
+    if (search_pike)
+        return scratch->pike_vm.search(haystack, from, begin);
+
+    const Backtracker &backtracker = scratch->backtracker;
+    Memo memo = {};
+    Memo *memoize = backtracker.reset(haystack, &memo);
+    while (starts != NULL) {
+        from = starts->first_start(haystack, from);
+        if (from == npos)
+            return npos;
+        u64 match = backtracker.search(haystack, from, from, begin, memoize);
+        if (match != npos)
+            return match;
+        from++;
+    }
+    for (;;) {
+        u64 match = backtracker.search(haystack, from, end, begin, memoize);
+        if (match != npos)
+            return match;
+        if (end >= haystack.len or !prefilter.window(haystack, end + 1, &from, &end))
+            return npos;
+    }
+}
+
+Match Regex::find(string haystack, Scratch *scratch) const
+{
+    u64 from = 0;
+    u64 end = haystack.len;
+    u64 begin = npos;
+
+    if (!node_head or (!prefilter.empty() and !prefilter.window(haystack, 0, &from, &end)))
+        return new_match(haystack, npos);
+    if (scratch == NULL)
+        scratch = thread_scratch(this);
+
+    switch (engine) {
+    case Engine_Backtrack:
+        end = search_backtrack(haystack, from, end, &begin, scratch);
+        break;
+    case Engine_Dfa:
+        end = dfa.search(haystack, from);
+        break;
+    case Engine_Lazy_Dfa:
+        end = scratch->lazy_dfa.search(haystack, from);
+        break;
+    case Engine_Pike:
+        end = scratch->pike_vm.search(haystack, from, &begin);
+        break;
+    }
+
+    if (end == npos)
+        return new_match(haystack, npos);
+    if (begin == npos)
+        begin = reverse.submit(&prog, haystack, from, end, &scratch->reverse);
+    return new_match(haystack.begin_at(&haystack.data[begin]), end - begin);
+}
+
+Match_Range Regex::find_all(string haystack, Scratch *scratch) const
+{
+    return Match_Range{this, scratch, haystack};
+}
+
+Match_Iterator Match_Range::begin() const
+{
+    return Match_Iterator{regex, scratch, regex->find(haystack, scratch)};
+}
+
+Match_Iterator Match_Range::end() const
+{
+    return Match_Iterator{regex, scratch, {}};
+}
+
+const Match &Match_Iterator::operator*() const
+{
+    return match;
+}
+
+Match_Iterator &Match_Iterator::operator++()
+{
+    string next = match.next;
+    if (match.view.len == 0) {
+        if (next.len == 0) {
+            match = {};
+            return *this;
+        }
+        next = next.begin_at(&next.data[1]);
+    }
+    match = regex->find(next, scratch);
+    return *this;
+}
+
+bool Match_Iterator::operator!=(const Match_Iterator &it) const
+{
+    return match.ok != it.match.ok or (match.ok and match.view.data != it.match.view.data);
+}
+
+// The engine is picked once for the whole slice, the automata keep their
+// scratch from one input to the next
+void match_slice(const Regex *regex, Scratch *scratch, View<string> inputs, Match *out)
+{
+    if (!regex->node_head) {
+        for (size_t i = 0; i < inputs.len; i++)
+            out[i] = new_match(inputs[i], npos);
+        return;
+    }
+
+    switch (regex->engine) {
+    case Engine_Backtrack:
+        for (size_t i = 0; i < inputs.len; i++)
+            out[i] = new_match(inputs[i], regex->backtrack(inputs[i], scratch));
+        break;
+    case Engine_Dfa:
+        for (size_t i = 0; i < inputs.len; i++)
+            out[i] = new_match(inputs[i], regex->dfa.submit(inputs[i]));
+        break;
+    case Engine_Lazy_Dfa:
+        for (size_t i = 0; i < inputs.len; i++)
+            out[i] = new_match(inputs[i], scratch->lazy_dfa.submit(inputs[i]));
+        break;
+    case Engine_Pike:
+        for (size_t i = 0; i < inputs.len; i++)
+            out[i] = new_match(inputs[i], scratch->pike_vm.submit(inputs[i]));
+        break;
+    }
+}
+
+void Regex::match_batch(View<string> inputs, View<Match> out) const
+{
+    Assert(out.len >= inputs.len, "cannot match_batch() into a smaller output");
+    match_slice(this, thread_scratch(this), inputs, out.data);
 }
 
+// Contiguous slices, one per thread of the pool
+struct Batch_Job
+{
+    const Regex *regex;
+    View<string> inputs;
+    Match *out;
+    Scratch *scratches;
+    u32 slices;
+};
+
+const size_t Batch_Slice_Min = 256;
+
+void match_batch_slice(void *data, u32 index)
+{
+    auto job = (Batch_Job *)data;
+    size_t len = (job->inputs.len + job->slices - 1) / job->slices;
+    size_t begin = Min(index * len, job->inputs.len);
+    size_t end = Min(begin + len, job->inputs.len);
+
+    View<string> inputs = {&job->inputs.data[begin], end - begin};
+    match_slice(job->regex, &job->scratches[index], inputs, &job->out[begin]);
+}
+
+// Every slice gets its own scratch
+void Regex::match_batch(View<string> inputs, View<Match> out, Thread_Pool *pool) const
+{
+    Assert(out.len >= inputs.len, "cannot match_batch() into a smaller output");
+
+    u32 slices = Min(inputs.len / Batch_Slice_Min, (size_t)pool->size());
+    if (slices < 2)
+        return match_batch(inputs, out);
+
+    Vec<Scratch> scratches = new_vec<Scratch>(slices);
+    defer(scratches.deinit());
+    defer(for (u32 i = 0; i < scratches.len; i++) scratches[i].deinit());
+    for (u32 i = 0; i < slices; i++)
+        scratches.push(new_scratch(this));
+
+    Batch_Job job = {this, inputs, out.data, scratches.data, slices};
+    pool->run(slices, match_batch_slice, &job);
+}
+
+// Patterns of up to 64 consumed bytes without lookaround run on the position
+// automaton, '~' with a literal stays on the backtracker that skips to it and
+// so does '', which fails at the end of the input there
+bool fits_glushkov(const Node_Arena *arena)
+{
+    u32 len = 0;
+    for (size_t i = 0; i < arena->len; i++) {
+        const State &state = (*arena)[i].state;
+        if ((*arena)[i].until)
+            return false;
+        switch (state.option) {
+        case Regex_Not:
+        case Regex_Dash:
+            return false;
+        case Regex_Str:
+            if (state.str.len == 0)
+                return false;
+            len += state.str.len;
+            break;
+        case Regex_Any:
+        case Regex_Set:
+        case Regex_Scope:
+            len++;
+            break;
+        default:
+            break;
+        }
+    }
+    return len <= Glushkov_Positions;
+}
+
+// '' fails at the end of the input on the backtracker and matches on the
+// program, the searches of the Pike VM would not agree with it there
+bool has_empty_literal(const Node_Arena *arena)
+{
+    for (size_t i = 0; i < arena->len; i++) {
+        const State &state = (*arena)[i].state;
+        if (state.option == Regex_Str and state.str.len == 0)
+            return true;
+    }
+    return false;
+}
+
+const u32 Trie_Branches_Min = 8;
+
+// Count of the literal branches the edges of 'node' start with, simplify()
+// can leave other branches after them
+u32 literal_span(const Node *node)
+{
+    u32 span = 0;
+    for (; span < node->out.len and !node->until; span++) {
+        const State &state = node->out[span]->state;
+        bool literal = state.option == Regex_Set or state.option == Regex_Scope or
+                       (state.option == Regex_Str and state.str.len > 0);
+        if (!literal)
+            break;
+    }
+    return span;
+}
+
+// An alternation that starts with at least Trie_Branches_Min literals
+bool is_wide_alternation(const Node *node)
+{
+    return literal_span(node) >= Trie_Branches_Min;
+}
+
+// Every match starts with a key of the head, the starts of a search are
+// found by its trie alone
+bool starts_with_keys(const Node *head)
+{
+    return head->state.option == Regex_Eps and !head->leaf and literal_span(head) == head->out.len;
+}
+
+struct Byte_Table
+{
+    char bytes[256];
+
+    constexpr Byte_Table() : bytes()
+    {
+        for (u32 c = 0; c < 256; c++)
+            bytes[c] = (char)c;
+    }
+};
+
+constexpr Byte_Table Bytes = {};
+
+// A set branch is a key of one byte for each of its bytes
+void compile_tries(Regex *regex)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < regex->arena.len; i++)
+        count += is_wide_alternation(&regex->arena[i]);
+    if (!count)
+        return;
+
+    regex->tries = new_vec<Trie>(count);
+    Vec<Trie_Key> keys = new_vec<Trie_Key>(64);
+    defer(keys.deinit());
+
+    for (size_t i = 0; i < regex->arena.len; i++) {
+        Node &node = regex->arena[i];
+        if (!is_wide_alternation(&node))
+            continue;
+
+        keys.len = 0;
+        u32 span = literal_span(&node);
+        for (u32 branch = 0; branch < span; branch++) {
+            const State &state = node.out[branch]->state;
+            if (state.option == Regex_Str) {
+                keys.push({state.str, branch});
+                continue;
+            }
+            for (u32 c = state.set.next(0); c < 256; c = state.set.next(c + 1))
+                keys.push({string{&Bytes.bytes[c], 1}, branch});
+        }
+        bool head = &node == regex->node_head and starts_with_keys(&node);
+        Trie trie = compile_trie(View<Trie_Key>{keys.data, keys.len}, head);
+        trie.span = span;
+        node.trie = &regex->tries.push(trie);
+        if (head)
+            regex->starts = node.trie;
+    }
+}
+
+u64 Regex::backtrack(string expr, Scratch *scratch) const
+{
+    if (glushkov.offsets.len)
+        return glushkov.submit(expr, &scratch->lives);
+    return scratch->backtracker.submit(expr);
+}
+
+void Scratch::deinit()
+{
+    backtracker.deinit();
+    pike_vm.deinit();
+    reverse.deinit();
+    lazy_dfa.deinit();
+    lives.deinit();
+}
+
+// Only the engine of the regex gets its memory, the Dfa and the position
+// automaton match without any
+Scratch new_scratch(const Regex *regex)
+{
+    Scratch scratch = {};
+    if (!regex->node_head)
+        return scratch;
+
+    switch (regex->engine) {
+    case Engine_Backtrack:
+        if (!regex->glushkov.offsets.len)
+            scratch.backtracker = new_backtracker(regex->node_head, regex->arena.len, regex->memo_size);
+        if (regex->search_pike)
+            scratch.pike_vm = new_pike_vm(&regex->prog);
+        break;
+    case Engine_Dfa:
+        break;
+    case Engine_Lazy_Dfa:
+        compile_lazy_dfa(&regex->prog, &scratch.lazy_dfa, regex->cache_size);
+        break;
+    case Engine_Pike:
+        scratch.pike_vm = new_pike_vm(&regex->prog);
+        break;
+    }
+    return scratch;
+}
+
+// The scratch of the calls made without one, a thread keeps the one of the
+// last regex it matched. The regexes are told apart by their serial as the
+// address of a freed one can be reused.
+const u32 Thread_Scratch_Slots = 8;
+
+// The scratches of the last regexes a thread matched, the one used the
+// longest ago is made again for a new regex
+struct Thread_Scratch
+{
+    u64 serial;
+    u64 used;
+    Scratch scratch;
+};
+
+struct Thread_Scratches
+{
+    Thread_Scratch slots[Thread_Scratch_Slots];
+    u64 clock;
+
+    ~Thread_Scratches()
+    {
+        for (Thread_Scratch &slot : slots)
+            slot.scratch.deinit();
+    }
+};
+
+thread_local Thread_Scratches Thread_Cache = {};
+
+Scratch *thread_scratch(const Regex *regex)
+{
+    Thread_Scratches &cache = Thread_Cache;
+    Thread_Scratch *oldest = &cache.slots[0];
+    cache.clock++;
+    for (Thread_Scratch &slot : cache.slots) {
+        if (slot.serial == regex->serial) {
+            slot.used = cache.clock;
+            return &slot.scratch;
+        }
+        if (slot.used < oldest->used)
+            oldest = &slot;
+    }
+
+    oldest->scratch.deinit();
+    oldest->scratch = new_scratch(regex);
+    oldest->serial = regex->serial;
+    oldest->used = cache.clock;
+    return &oldest->scratch;
+}
+
+std::atomic<u64> Regex_Serials = 0;
+
 } // namespace bee::regex
 
 namespace bee
 {
 
-Regex compile_regex(string source)
+Regex compile_regex(string source, regex::Engine engine)
 {
+    return compile_regex(source, regex::new_config(engine));
+}
+
+Regex compile_regex(string source, regex::Config config)
+{
+    using namespace regex;
+
     Regex regex = {};
     regex.source = source;
-    regex.node_head = new_parser(source, &regex.arena).parse();
+    regex.serial = ++Regex_Serials;
+    regex.memo_size = config.memo_size;
+    regex.cache_size = config.cache_size;
+    // one allocation for the edges of most patterns, and one for the operands
+    Node_Set_Pool sets = new_pool<Node_Set>();
+    Vec<Node *> sequences = new_vec<Node *>(16);
+    defer(sets.deinit());
+    defer(sequences.deinit());
+
+    regex.arena = new_block_arena<Node>();
+    regex.node_head = new_parser(source, &regex.arena, &sets, &sequences).parse();
+    regex.strings = new_vec<char>(source.len + 1);
+    simplify(&regex.arena, &regex.node_head, config.passes, &regex.strings);
+    regex.freeze();
+    regex.prefilter = compile_prefilter(&regex.arena, regex.node_head);
+
+    if (config.engine != Engine_Backtrack)
+        regex.prog = compile_prog(&regex.arena, regex.node_head);
+
+    switch (config.engine) {
+    case Engine_Backtrack:
+        break;
+    case Engine_Dfa:
+        if (compile_dfa(&regex.prog, &regex.dfa))
+            regex.engine = Engine_Dfa;
+        break;
+    case Engine_Lazy_Dfa:
+        // its states are built by the scratch of every thread
+        if (!regex.prog.has_lookaround)
+            regex.engine = Engine_Lazy_Dfa;
+        break;
+    case Engine_Pike:
+        regex.engine = Engine_Pike;
+        break;
+    }
+
+    // the graph is only walked by the backtracker when the pattern does not
+    // fit the position automaton, the others search with the Pike VM
+    if (regex.engine == Engine_Backtrack and regex.node_head != NULL) {
+        if (config.engine == Engine_Backtrack)
+            regex.prog = compile_prog(&regex.arena, regex.node_head);
+        if (!fits_glushkov(&regex.arena) or !compile_glushkov(&regex.prog, &regex.glushkov))
+            regex.search_pike = !has_empty_literal(&regex.arena);
+    }
+    if (regex.engine == Engine_Backtrack and !regex.glushkov.offsets.len)
+        compile_tries(&regex);
+    // a wide alternation of keywords at the head is searched through its
+    // trie, the Pike VM would run every branch at every offset
+    if (regex.starts != NULL)
+        regex.search_pike = false;
+
+    // the automata only find the end of a match, the start is found backward
+    if (regex.engine == Engine_Dfa or regex.engine == Engine_Lazy_Dfa)
+        regex.reverse = compile_reverse_prog(&regex.prog);
     return regex;
 }
 
@@ -518,10 +1229,11 @@ const string Graph_Not_Mode = R"(style=filled;bgcolor="#FBF3F3)";
 const string Graph_Dash_Mode = R"(style=filled;bgcolor="#F4FDFF)";
 
 void format_graph(Context *context, Device *dev, Regex *regex);
-void format_node(Context *context, Device *dev, Node *node);
+void format_members(Context *context, Device *dev, Node *node, Vec<u8> *visited);
+void format_node(Context *context, Device *dev, Node *node, Vec<u8> *visited);
 void format_define(Context *context, Device *dev, Node *node);
 void format_connect(Context *context, Device *dev, Node *node, Node *edge);
-void format_subgraph(Context *context, Device *dev, Node *node, string mode);
+void format_subgraph(Context *context, Device *dev, Node *node, string mode, Vec<u8> *visited);
 
 void format(Context *context, Device *dev, State state)
 {
@@ -542,20 +1254,21 @@ void format(Context *context, Device *dev, State state)
         return dev->format("/");
     case Regex_Str:
         return dev->format("%(s:?)", state.str);
-    case Regex_Scope:
-        return dev->format("[%(c:?)..%(c:?)]", state.range[0], state.range[1]);
 
-    case Regex_Set: {
-        switch (state.str.len) {
+    case Regex_Set:
+    case Regex_Scope: {
+        u32 a = state.set.next(0);
+        u32 b = a;
+        for (u32 c = a; c < 256; c = state.set.next(c + 1))
+            b = c;
+
+        switch (state.set.count()) {
         case 0:
             return dev->format("[]");
         case 1:
-            return dev->format("[%(c:?)]", state.str[0]);
-        default: {
-            char a = state.str[0];
-            char b = state.str[state.str.len - 1];
-            return dev->format("[%(c:?)..%(c:?)]", a, b);
-        }
+            return dev->format("[%(c:?)]", (char)a);
+        default:
+            return dev->format("[%(c:?)..%(c:?)]", (char)a, (char)b);
         }
     }
     }
@@ -577,15 +1290,28 @@ void format_graph(Context *context, Device *dev, Regex *regex)
         dev->format(R"(" %(s:?) " [shape="none"]%c)", regex->source, '\n');
         dev->format(R"(" %(s:?) " -> "%p" [label="%v"]%c)", regex->source, (void *)head, head->state, '\n');
 
-        auto members = head->make_members();
-        for (auto it = members; it != NULL; it = it->next)
-            format_node(context, dev, it->node);
+        Vec<u8> visited = new_vec<u8>(regex->arena.len);
+        visited.reserve_with(regex->arena.len, false);
+        visited.len = regex->arena.len;
+        defer(visited.deinit());
+        format_members(context, dev, head, &visited);
     }
 
     dev->format("}");
 }
 
-void format_subgraph(Context *context, Device *dev, Node *node, string mode)
+void format_members(Context *context, Device *dev, Node *node, Vec<u8> *visited)
+{
+    if ((*visited)[node->id])
+        return;
+    (*visited)[node->id] = true;
+
+    format_node(context, dev, node, visited);
+    for (Node *edge : node->out)
+        format_members(context, dev, edge, visited);
+}
+
+void format_subgraph(Context *context, Device *dev, Node *node, string mode, Vec<u8> *visited)
 {
     Node *sequence = node->state.sequence;
 
@@ -593,38 +1319,31 @@ void format_subgraph(Context *context, Device *dev, Node *node, string mode)
     dev->format("%s\n", mode);
     format_define(context, dev, node);
     format_connect(context, dev, node, sequence);
-
-    auto members = node->make_members();
-
-    for (auto it = members; it != NULL; it = it->next) {
-        format_node(context, dev, it->node);
-    }
+    format_members(context, dev, sequence, visited);
     dev->format("}\n");
 
-    Node *end = sequence->end();
-    for (auto it = node->edges; it != NULL; it = it->next) {
-        format_connect(context, dev, end, it->node);
-    }
+    for (Node *edge : node->out)
+        format_connect(context, dev, node, edge);
 }
 
-void format_node(Context *context, Device *dev, Node *node)
+void format_node(Context *context, Device *dev, Node *node, Vec<u8> *visited)
 {
     switch (node->state.option) {
     case Regex_Not:
-        return format_subgraph(context, dev, node, Graph_Not_Mode);
+        return format_subgraph(context, dev, node, Graph_Not_Mode, visited);
     case Regex_Dash:
-        return format_subgraph(context, dev, node, Graph_Dash_Mode);
+        return format_subgraph(context, dev, node, Graph_Dash_Mode, visited);
 
     default:
         format_define(context, dev, node);
-        for (auto it = node->edges; it != NULL; it = it->next)
-            format_connect(context, dev, node, it->node);
+        for (Node *edge : node->out)
+            format_connect(context, dev, node, edge);
     }
 }
 
 void format_define(Context *context, Device *dev, Node *node)
 {
-    string shape = node->has_edges() ? "square" : "circle";
+    string shape = !node->leaf ? "square" : "circle";
     dev->format(R"("%p" [shape="%s", label="%d"]%c)", (void *)node, shape, node->id, '\n');
 }
 
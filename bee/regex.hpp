@@ -2,14 +2,19 @@
 #define BEE_REGEX_HPP
 
 #include "format.hpp"
+#include "regex_dfa.hpp"
+#include "regex_glushkov.hpp"
+#include "regex_pike.hpp"
+#include "regex_prefilter.hpp"
+#include "regex_trie.hpp"
 
 namespace bee
 {
+struct Thread_Pool;
 
 namespace regex
 {
-typedef Arena<struct Node, 128> Node_Arena;
-typedef Arena<struct Node *, 128> Node_Seq_Arena;
+typedef Block_Arena<struct Node> Node_Arena;
 
 enum Option
 {
@@ -28,12 +33,30 @@ struct Monostate
 {
 };
 
+struct Node;
+
+// Failed (node, n) pairs of the backtracker, a node that failed once at 'n'
+// fails every time so the branch is skipped. The bits of an offset are in
+// one row, the rows are cleared as the runs reach them so a search pays for
+// the offsets it reads and not for the whole input.
+struct Memo
+{
+    u64 *bits;
+    u64 nodes;
+    u64 clean; // rows from this offset on are not cleared yet
+
+    bool has(const Node *node, u64 n) const;
+    void insert(const Node *node, u64 n);
+};
+
+const size_t Memo_Size = 256 << 10;
+
 struct State
 {
     Option option;
     union {
         Monostate monostate;
-        char range[2];
+        Byte_Set set;
         string str;
         Node *sequence;
     };
@@ -41,37 +64,82 @@ struct State
     u64 submit(string expr, u64 n) const;
 };
 
-struct Node;
 struct Node_Set
 {
     Node *node;
     Node_Set *next;
 };
 
-Node_Set *node_set_insert(Node_Set *set, Node *node);
-void node_set_deinit(Node_Set *set);
+// Every edge of the parser is a cell of one pool, freed at once after freeze()
+typedef Pool<Node_Set> Node_Set_Pool;
 
+// Edges are built in 'edges' by the parser, 'last_edge' ends the list.
+// Regex::freeze() packs them into 'out' and numbers the nodes by arena slot,
+// matchers only use 'out'.
+// A leaf has no forward edge, while parsing the leaves of the sequence headed
+// by a node are chained from 'tails' through 'next_tail'. An 'until' node
+// heads 'a ~ b' with a single byte 'a' and a literal 'b', out is [b, a].
+// While parsing a 'literals' node heads an alternation of literal leaves that
+// takes more branches, the backtracker picks the branches of a wide one from
+// its 'trie'
 struct Node
 {
     State state;
     Node_Set *edges;
-    Node_Set *member_cache;
+    Node_Set *last_edge;
+    Node *tails;
+    Node *last_tail;
+    Node *next_tail;
+    View<Node *> out;
     u32 id;
+    bool leaf;
+    bool until;
+    bool literals;
+    const Trie *trie;
 
-    void deinit();
-    u64 submit(string expr, u64 n) const;
-    Node *push(Node *node);
-    Node *merge(Node *node);
-    Node *concat(Node *node);
-    Node *end();
-    Node *max_edge() const;
-    bool has_edges() const;
+    void push_edge(Node *node, Node_Set_Pool *pool);
+    Node *push(Node *node, Node_Set_Pool *pool);
+    Node *merge(Node *node, Node_Set_Pool *pool);
+    Node *concat(Node *node, Node_Set_Pool *pool);
+    void join_tails(Node *node);
+};
 
-    void map_sequence_ids(u32 zero);
-    Node_Set *make_members();
-    void when_edges_are_modified();
+// Depth first walk of the graph from the head with an explicit stack, a
+// frame is pushed for every node of the path that has another edge to try,
+// so the input length is not bound by the thread stack. The first path that
+// reaches a leaf at the end of the input, or a leaf none of whose edges lead
+// to a match, gives the end of the match.
+struct Backtrack_Frame
+{
+    const Node *node;
+    u64 n;
+    u64 match; // end of the node, for an until node the end of the 'a' run
+    u64 next;  // next edge to try, for an until node where 'b' is searched next
 };
 
+struct Backtrack_Scratch
+{
+    Vec<Backtrack_Frame> frames;
+    Vec<u64> bits;
+};
+
+struct Backtracker
+{
+    const Node *head;
+    size_t nodes;
+    size_t memo_size;
+    Backtrack_Scratch *scratch;
+
+    void deinit();
+    Memo *reset(string expr, Memo *memo) const;
+    u64 submit(string expr) const;
+    u64 search(string expr, u64 from, u64 end, u64 *begin, Memo *memo) const;
+    u64 run(const Node *node, string expr, u64 n, Memo *memo) const;
+    u64 step(const State &state, string expr, u64 n, Memo *memo) const;
+};
+
+Backtracker new_backtracker(const Node *head, size_t nodes, size_t memo_size);
+
 struct Binary
 {
     Node *a, *b;
@@ -82,17 +150,22 @@ struct Parser
     string source;
     const char *token;
     Node_Arena *arena;
-    Node_Seq_Arena sequences;
+    Node_Set_Pool *sets;
+    Vec<Node *> *sequences; // shared with the nested parsers, this one starts at 'base'
+    size_t base;
+    bool nested;
+    bool closed;
 
     Node *parse();
     Node *parse_next_token();
-    string parse_subsequence();
+    Node *new_node(Option option);
 
     Binary parse_binary_op(char op);
     Node *parse_pre_op(char op);
     Node *parse_post_op(char op);
 
     Node *parse_set(string set);
+    Node *parse_set_or(Node *a, Node *b);
     Node *parse_scope();
     Node *parse_any();
     Node *parse_str(char quote);
@@ -121,7 +194,44 @@ struct Parser
     }
 };
 
-Parser new_parser(string source, Node_Arena *arena);
+Parser new_parser(string source, Node_Arena *arena, Node_Set_Pool *sets, Vec<Node *> *sequences);
+
+// Passes of simplify() over the graph of the parser, each one keeps the
+// matches and their priority
+enum Pass
+{
+    Pass_Dead = 1 << 0,     // edges to nodes that never match
+    Pass_Eps = 1 << 1,      // epsilons between two nodes or at the end of one
+    Pass_Sets = 1 << 2,     // branches of one byte that go on the same way
+    Pass_Literals = 1 << 3, // a string that only leads to a string
+    Pass_All = 0xf,
+};
+
+// 'refs' counts the edges into a node from the ones reached from the head,
+// plus one for the head and for the sequence of a lookaround. A node left
+// without any is dropped by Regex::freeze()
+struct Simplifier
+{
+    Node_Arena *arena;
+    Node **head;
+    Vec<u32> refs;
+    Vec<u8> fixed; // the literal and the byte of an until node are read in place
+    Vec<Node *> stack;
+
+    void deinit();
+    void unref(Node *node);
+    void mark_cycles(Vec<u8> *cyclic);
+    Node *next_literal(const Node *node) const;
+
+    void drop_dead();
+    void fold_eps();
+    void fold_sets();
+    void merge_literals(Vec<char> *strings);
+};
+
+Simplifier new_simplifier(Node_Arena *arena, Node **head);
+// 'strings' holds the merged literals, it must have room for the source
+void simplify(Node_Arena *arena, Node **head, u32 passes, Vec<char> *strings);
 
 struct Match
 {
@@ -132,20 +242,107 @@ struct Match
 
 Match new_match(string expr, u64 index);
 
+enum Engine
+{
+    Engine_Backtrack,
+    Engine_Dfa,
+    Engine_Lazy_Dfa,
+    Engine_Pike,
+};
+
+struct Config
+{
+    Engine engine;
+    size_t cache_size; // Engine_Lazy_Dfa memory budget in bytes
+    size_t memo_size;  // Engine_Backtrack memoization bitmap cap in bytes, 0 disables it
+    u32 passes;        // Pass_* of simplify() run on the graph
+};
+
+Config new_config(Engine engine = Engine_Backtrack);
+
+struct Scratch;
+
+// Non overlapping matches from left to right, an empty match moves the
+// search one byte further
+struct Match_Iterator
+{
+    const struct Regex *regex;
+    Scratch *scratch;
+    Match match;
+
+    const Match &operator*() const;
+    Match_Iterator &operator++();
+    bool operator!=(const Match_Iterator &it) const;
+};
+
+struct Match_Range
+{
+    const struct Regex *regex;
+    Scratch *scratch;
+    string haystack;
+
+    Match_Iterator begin() const;
+    Match_Iterator end() const;
+};
+
 struct Regex
 {
     string source;
+    u64 serial; // unique to the compiled regex, its copies share it
     Node *node_head;
     Node_Arena arena;
+    Vec<Node *> edges;
+    Vec<char> strings; // literals merged by simplify()
+    Prefilter prefilter;
+    Engine engine;
+    size_t memo_size;
+    size_t cache_size;
+    Prog prog;
+    Reverse_Prog reverse;
+    Dfa dfa;
+    Glushkov glushkov; // small patterns of Engine_Backtrack, its offsets are empty otherwise
+    bool search_pike;  // Engine_Backtrack finds with the Pike VM of 'prog'
+    Vec<Trie> tries;
+    const Trie *starts; // unanchored trie of the head when every match starts with one of its keys
 
     void deinit();
-    Match match(string expr) const;
+    void freeze();
+    // without a scratch they run in the one of the calling thread
+    Match match(string expr, Scratch *scratch = NULL) const;
+    Match find(string haystack, Scratch *scratch = NULL) const;
+    Match_Range find_all(string haystack, Scratch *scratch = NULL) const;
+    void match_batch(View<string> inputs, View<Match> out) const;
+    void match_batch(View<string> inputs, View<Match> out, Thread_Pool *pool) const;
+    u64 backtrack(string expr, Scratch *scratch) const;
+    u64 search_backtrack(string haystack, u64 from, u64 end, u64 *begin, Scratch *scratch) const;
 };
 
+// The engines of a regex with the memory they match in. Matching does not
+// change a compiled regex, so the threads share one, each with its own
+// scratch. The lazy Dfa builds its states into the scratch, they are kept
+// from one match to the next.
+struct Scratch
+{
+    Backtracker backtracker;
+    Pike_Vm pike_vm;
+    Reverse_Lists reverse; // the start of a match an automaton only ends
+    Lazy_Dfa lazy_dfa;
+    Vec<u64> lives; // live threads of the position automaton at every byte
+
+    void deinit();
+};
+
+Scratch new_scratch(const Regex *regex);
+// The scratch of the calling thread for 'regex', the thread keeps one for
+// each of the last few regexes it matched
+Scratch *thread_scratch(const Regex *regex);
+
 }; // namespace regex
 
 using regex::Regex;
-Regex compile_regex(string source);
+// Falls back to Engine_Backtrack when the pattern is not supported by 'engine'
+Regex compile_regex(string source, regex::Engine engine = regex::Engine_Backtrack);
+Regex compile_regex(string source, regex::Config config);
 
 namespace fmt
 {
@@ -0,0 +1,216 @@
+#include "regex_cache.hpp"
+
+namespace bee::regex
+{
+
+u32 hash_source(string source)
+{
+    u32 h = 2166136261u;
+    for (size_t i = 0; i < source.len; i++)
+        h = (h ^ (u8)source.data[i]) * 16777619u;
+    return h;
+}
+
+void Regex_Cache::deinit()
+{
+    for (u32 entry = head; entry != Regex_Cache_Nil; entry = entries[entry].next) {
+        entries[entry].regex->deinit();
+        delete entries[entry].regex;
+        delete[] entries[entry].source.data;
+    }
+    entries.deinit();
+    slots.deinit();
+    free.deinit();
+    head = tail = Regex_Cache_Nil;
+    stats = {};
+    delete lock;
+    lock = NULL;
+}
+
+const Regex *Regex_Cache::acquire(string source, Engine engine)
+{
+    std::lock_guard<std::mutex> guard(*lock);
+    u32 hash = hash_source(source);
+    u32 entry = lookup(source, engine, hash);
+
+    if (entry != Regex_Cache_Nil) {
+        stats.hits++;
+        unlink(entry);
+        link_front(entry);
+    } else {
+        stats.misses++;
+        entry = insert(source, engine, hash);
+    }
+
+    entries[entry].refs++;
+    return entries[entry].regex;
+}
+
+// The regex stays cached, it can be evicted once nobody holds it
+void Regex_Cache::release(const Regex *regex)
+{
+    std::lock_guard<std::mutex> guard(*lock);
+    u32 mask = slots.len - 1;
+    u32 i = hash_source(regex->source) & mask;
+    while (slots[i] != 0 and entries[slots[i] - 1].regex != regex)
+        i = (i + 1) & mask;
+
+    Assert(slots[i] != 0, "cannot release() a regex that is not cached");
+    Regex_Cache_Entry &entry = entries[slots[i] - 1];
+    Assert(entry.refs > 0, "cannot release() a regex that is not held");
+    entry.refs--;
+
+    if (stats.len > cap)
+        evict();
+}
+
+u32 Regex_Cache::lookup(string source, Engine engine, u32 hash) const
+{
+    u32 mask = slots.len - 1;
+    for (u32 i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+        const Regex_Cache_Entry &entry = entries[slots[i] - 1];
+        if (entry.hash == hash and entry.engine == engine and entry.source == source)
+            return slots[i] - 1;
+    }
+    return Regex_Cache_Nil;
+}
+
+// The regex is compiled from a copy of 'source', its nodes refer to it
+u32 Regex_Cache::insert(string source, Engine engine, u32 hash)
+{
+    if (stats.len >= cap)
+        evict();
+    if ((stats.len + 1) * 2 > slots.len)
+        grow_slots();
+
+    char *copy = new char[source.len + 1];
+    memcpy(copy, source.data, source.len);
+    copy[source.len] = '\0';
+
+    Regex_Cache_Entry cached = {};
+    cached.source = string{copy, source.len};
+    cached.engine = engine;
+    cached.hash = hash;
+    cached.regex = new Regex(compile_regex(cached.source, engine));
+
+    u32 entry = entries.len;
+    if (!free.empty())
+        entries[entry = free.pop()] = cached;
+    else
+        entries.push(cached);
+
+    u32 mask = slots.len - 1;
+    u32 i = hash & mask;
+    while (slots[i] != 0)
+        i = (i + 1) & mask;
+    slots[i] = entry + 1;
+
+    link_front(entry);
+    stats.len++;
+    return entry;
+}
+
+// Drops the least recently used regex nobody holds, if any
+void Regex_Cache::evict()
+{
+    u32 entry = tail;
+    while (entry != Regex_Cache_Nil and entries[entry].refs > 0)
+        entry = entries[entry].prev;
+    if (entry == Regex_Cache_Nil)
+        return;
+
+    unlink(entry);
+    remove_slot(entry);
+    entries[entry].regex->deinit();
+    delete entries[entry].regex;
+    delete[] entries[entry].source.data;
+    entries[entry] = {};
+    free.push(entry);
+    stats.len--;
+    stats.evictions++;
+}
+
+void Regex_Cache::unlink(u32 entry)
+{
+    Regex_Cache_Entry &it = entries[entry];
+    if (it.prev != Regex_Cache_Nil)
+        entries[it.prev].next = it.next;
+    else
+        head = it.next;
+    if (it.next != Regex_Cache_Nil)
+        entries[it.next].prev = it.prev;
+    else
+        tail = it.prev;
+    it.prev = it.next = Regex_Cache_Nil;
+}
+
+void Regex_Cache::link_front(u32 entry)
+{
+    entries[entry].prev = Regex_Cache_Nil;
+    entries[entry].next = head;
+    if (head != Regex_Cache_Nil)
+        entries[head].prev = entry;
+    head = entry;
+    if (tail == Regex_Cache_Nil)
+        tail = entry;
+}
+
+// Backward shift deletion, the slots after the hole that may move closer to
+// their home slot fill it so probing stops at the first empty slot
+void Regex_Cache::remove_slot(u32 entry)
+{
+    u32 mask = slots.len - 1;
+    u32 i = entries[entry].hash & mask;
+    while (slots[i] != entry + 1)
+        i = (i + 1) & mask;
+
+    for (u32 j = (i + 1) & mask; slots[j] != 0; j = (j + 1) & mask) {
+        u32 home = entries[slots[j] - 1].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+            slots[i] = slots[j], i = j;
+    }
+    slots[i] = 0;
+}
+
+void Regex_Cache::grow_slots()
+{
+    u32 len = slots.len * 2;
+    slots.deinit();
+    slots = new_vec<u32>(len);
+    slots.reserve_with(len, 0);
+    slots.len = len;
+
+    u32 mask = len - 1;
+    for (u32 entry = head; entry != Regex_Cache_Nil; entry = entries[entry].next) {
+        u32 i = entries[entry].hash & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = entry + 1;
+    }
+}
+
+Regex_Cache new_regex_cache(size_t cap)
+{
+    u32 slots_len = 16;
+    while (slots_len < cap * 2)
+        slots_len *= 2;
+
+    Regex_Cache cache = {};
+    cache.entries = new_vec<Regex_Cache_Entry>(Min(cap, 64) + 1);
+    cache.slots = new_vec<u32>(slots_len);
+    cache.slots.reserve_with(slots_len, 0);
+    cache.slots.len = slots_len;
+    cache.free = new_vec<u32>(16);
+    cache.head = cache.tail = Regex_Cache_Nil;
+    cache.cap = cap;
+    cache.lock = new std::mutex();
+    return cache;
+}
+
+Regex_Cache *regex_cache()
+{
+    static Regex_Cache cache = new_regex_cache();
+    return &cache;
+}
+
+} // namespace bee::regex
@@ -0,0 +1,72 @@
+#ifndef BEE_REGEX_CACHE_HPP
+#define BEE_REGEX_CACHE_HPP
+
+#include "regex.hpp"
+#include <mutex>
+
+namespace bee::regex
+{
+
+// Compiled regexes interned by pattern source and engine, compiling a
+// pattern again costs one hash lookup. The cache owns a copy of every source
+// and the regex compiled from it.
+//
+// A regex is held from acquire() until its release(), only the least
+// recently used regexes that nobody holds are evicted past 'cap'. When every
+// regex is held the cache grows past 'cap' rather than evicting them.
+//
+// acquire() and release() take the lock of the cache, any thread can call
+// them. A held regex is only read, the threads match it with their own scratch.
+const size_t Regex_Cache_Cap = 256;
+const u32 Regex_Cache_Nil = (u32)-1;
+
+struct Regex_Cache_Stats
+{
+    u64 hits;
+    u64 misses;
+    u64 evictions;
+    u32 len;
+};
+
+struct Regex_Cache_Entry
+{
+    string source;
+    Engine engine;
+    u32 hash;
+    u32 refs;
+    u32 prev; // more recently used
+    u32 next; // less recently used
+    Regex *regex;
+};
+
+struct Regex_Cache
+{
+    Vec<Regex_Cache_Entry> entries;
+    Vec<u32> slots; // entry + 1, 0 is empty
+    Vec<u32> free;
+    u32 head;
+    u32 tail;
+    size_t cap;
+    Regex_Cache_Stats stats;
+    std::mutex *lock;
+
+    void deinit();
+    const Regex *acquire(string source, Engine engine = Engine_Backtrack);
+    void release(const Regex *regex);
+
+    u32 lookup(string source, Engine engine, u32 hash) const;
+    u32 insert(string source, Engine engine, u32 hash);
+    void evict();
+    void unlink(u32 entry);
+    void link_front(u32 entry);
+    void remove_slot(u32 entry);
+    void grow_slots();
+};
+
+Regex_Cache new_regex_cache(size_t cap = Regex_Cache_Cap);
+// Process wide cache of Regex_Cache_Cap regexes, shared by every thread
+Regex_Cache *regex_cache();
+
+} // namespace bee::regex
+
+#endif
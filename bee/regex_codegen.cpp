@@ -0,0 +1,129 @@
+#include "regex_codegen.hpp"
+
+namespace bee::regex
+{
+
+enum Gen_Flag
+{
+    Gen_Accept = 1 << 0,
+    Gen_Target = 1 << 1, // a transition jumps to its label
+};
+
+const u32 Gen_Labels_Per_Line = 8;
+
+// Jumps to the label of 'next', falling into the dead state ends the match
+void generate_jump(fmt::Device *dev, u32 next)
+{
+    if (next == Dfa_Dead)
+        dev->format("        return match;\n");
+    else
+        dev->format("        goto s%d;\n", next);
+}
+
+// Bytes are grouped by the state they reach, the most common one is the default
+void generate_state(fmt::Device *dev, const Dfa *dfa, u32 state, u32 flags, Vec<u32> *counts)
+{
+    const u32 *row = &dfa->table.data[state << 8];
+
+    u32 common = row[0] >> 8;
+    for (u32 c = 0; c < 256; c++) {
+        u32 next = row[c] >> 8;
+        if (++(*counts)[next] > (*counts)[common])
+            common = next;
+    }
+
+    if (flags & Gen_Target)
+        dev->format("s%d:\n", state);
+    if (flags & Gen_Accept)
+        dev->format("    match = n;\n");
+    dev->format("    if (n == expr.len)\n");
+    dev->format("        return match;\n");
+    dev->format("    switch ((u8)expr.data[n++]) {\n");
+
+    for (u32 c = 0; c < 256; c++) {
+        u32 next = row[c] >> 8;
+        if (next == common or (*counts)[next] == 0)
+            continue;
+
+        // plain labels, a range label 'case a ... b' is a GNU extension
+        u32 labels = 0;
+        for (u32 a = c; a < 256; a++) {
+            if (row[a] >> 8 != next)
+                continue;
+            dev->format(labels % Gen_Labels_Per_Line == 0 ? "    case %d:" : " case %d:", a);
+            if (++labels % Gen_Labels_Per_Line == 0)
+                dev->format("\n");
+        }
+        if (labels % Gen_Labels_Per_Line != 0)
+            dev->format("\n");
+        generate_jump(dev, next);
+        (*counts)[next] = 0;
+    }
+
+    dev->format("    default:\n");
+    generate_jump(dev, common);
+    dev->format("    }\n");
+
+    for (u32 c = 0; c < 256; c++)
+        (*counts)[row[c] >> 8] = 0;
+}
+
+bool generate_matcher(fmt::Device *dev, string name, const Regex *regex)
+{
+    if (regex->engine != Engine_Dfa)
+        return false;
+
+    Dfa dfa = minimize_dfa(&regex->dfa);
+    defer(dfa.deinit());
+
+    dev->format("// %s: %(s:?)\n", name, regex->source);
+    dev->format("u64 submit_%s(string expr)\n{\n", name);
+
+    u32 start = dfa.start >> 8;
+    if (start == Dfa_Dead) {
+        // the input is never read
+        dev->format("    (void)expr;\n");
+        dev->format("    return npos;\n}\n\n");
+    } else {
+        dev->format("    u64 match = npos;\n");
+        dev->format("    u64 n = 0;\n\n");
+
+        // only the states reached from the start get a label, in the order they are reached
+        Sparse_Set reached = new_sparse_set(dfa.len);
+        Vec<u32> flags = new_vec<u32>(dfa.len);
+        Vec<u32> counts = new_vec<u32>(dfa.len);
+        flags.reserve_with(dfa.len, 0);
+        counts.reserve_with(dfa.len, 0);
+        flags.len = counts.len = dfa.len;
+        defer(reached.deinit(); flags.deinit(); counts.deinit());
+
+        reached.insert(start);
+        flags[start] = dfa.start & Dfa_Accept ? Gen_Accept : 0;
+        for (u32 i = 0; i < reached.len; i++) {
+            const u32 *row = &dfa.table.data[reached.dense[i] << 8];
+            for (u32 c = 0; c < 256; c++) {
+                u32 next = row[c] >> 8;
+                if (next == Dfa_Dead)
+                    continue;
+                reached.insert(next);
+                flags[next] |= Gen_Target | (row[c] & Dfa_Accept ? Gen_Accept : 0);
+            }
+        }
+
+        for (u32 state : reached)
+            generate_state(dev, &dfa, state, flags[state], &counts);
+        dev->format("}\n\n");
+    }
+
+    dev->format("Match match_%s(string expr)\n{\n", name);
+    dev->format("    return new_match(expr, submit_%s(expr));\n}\n\n", name);
+    return true;
+}
+
+void generate_declaration(fmt::Device *dev, string name)
+{
+    dev->format("u64 submit_%s(string expr);\n", name);
+    dev->format("Match match_%s(string expr);\n", name);
+}
+
+} // namespace bee::regex
@@ -0,0 +1,22 @@
+#ifndef BEE_REGEX_CODEGEN_HPP
+#define BEE_REGEX_CODEGEN_HPP
+
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+// Ahead of time matchers, the minimized Dfa of a regex is written as C++
+// where every state is a label and its row a switch over the next byte:
+//
+//   u64 submit_<name>(string expr); // Regex::match end, npos without a match
+//   Match match_<name>(string expr);
+//
+// The regex must be compiled with Engine_Dfa, lookaround and patterns past
+// Dfa_Max_States are rejected.
+bool generate_matcher(fmt::Device *dev, string name, const Regex *regex);
+void generate_declaration(fmt::Device *dev, string name);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,465 @@
+#include "regex_dfa.hpp"
+
+namespace bee::regex
+{
+
+void Dfa_States::deinit()
+{
+    keys.deinit();
+    offsets.deinit();
+    slots.deinit();
+    scratch.deinit();
+    stack.deinit();
+    set.deinit();
+}
+
+u32 hash_key(const u32 *key, size_t len)
+{
+    u32 h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ key[i]) * 16777619u;
+    return h;
+}
+
+// Returns the state of the current set, Dfa_Full when there is no room left
+u32 Dfa_States::intern(u32 accept)
+{
+    scratch.len = 0;
+    scratch.push(accept);
+    scratch.push(0);
+    for (u32 pc : set) {
+        if (prog->insts[pc].consumes())
+            scratch.push(pc);
+    }
+    scratch[1] = scratch.len - 2;
+
+    u32 mask = slots.len - 1;
+    for (u32 i = hash_key(scratch.data, scratch.len) & mask;; i = (i + 1) & mask) {
+        u32 state = slots[i];
+        if (state == 0) {
+            if (offsets.len >= max_states or keys.len + scratch.len > max_keys)
+                return Dfa_Full;
+            slots[i] = offsets.len + 1;
+            offsets.push(keys.len);
+            keys.concat(scratch.begin(), scratch.end());
+            return offsets.len - 1;
+        }
+        u32 offset = offsets[state - 1];
+        if (keys[offset + 1] == scratch[1] and !memcmp(&keys[offset], scratch.data, scratch.len * sizeof(u32)))
+            return state - 1;
+    }
+}
+
+// Fills the set with the threads following 'state' on 'c', returns the accept
+u32 Dfa_States::step(u32 state, u8 c)
+{
+    set.clear();
+
+    u32 accept = 0;
+    u32 cut = 0;
+    u32 offset = offsets[state];
+    u32 len = keys[offset + 1];
+    for (u32 i = 0; i < len; i++) {
+        const Inst &inst = prog->insts[keys[offset + 2 + i]];
+        if (cut and inst.rule == cut - 1)
+            continue;
+        if (!inst.step(c))
+            continue;
+
+        u32 match = prog->closure(inst.x, &set, &stack);
+        if (match and prog->rules == 0)
+            return match;
+        if (match)
+            cut = match, accept = accept ? accept : match;
+    }
+    return accept;
+}
+
+u32 Dfa_States::accepts(u32 state) const
+{
+    return keys[offsets[state]];
+}
+
+// Drops every state after the first 'len' states
+void Dfa_States::truncate(u32 len)
+{
+    Assert(len > 0 and len <= offsets.len, "cannot truncate dfa states");
+    u32 last = offsets[len - 1];
+    keys.len = last + 2 + keys[last + 1];
+    offsets.len = len;
+
+    u32 mask = slots.len - 1;
+    memset(slots.data, 0, slots.len * sizeof(u32));
+    for (u32 state = 0; state < len; state++) {
+        u32 offset = offsets[state];
+        u32 i = hash_key(&keys[offset], keys[offset + 1] + 2) & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = state + 1;
+    }
+}
+
+size_t Dfa_States::size() const
+{
+    return (keys.cap + offsets.cap + slots.cap + scratch.cap + stack.cap + 2 * set.cap) * sizeof(u32);
+}
+
+Dfa_States new_dfa_states(const Prog *prog, u32 max_states, size_t max_keys)
+{
+    u32 slots_len = 1;
+    while (slots_len < max_states * 2)
+        slots_len *= 2;
+
+    Dfa_States states = {};
+    states.prog = prog;
+    states.keys = new_vec<u32>(64);
+    states.offsets = new_vec<u32>(16);
+    states.slots = new_vec<u32>(slots_len);
+    states.slots.reserve_with(slots_len, 0);
+    states.slots.len = slots_len;
+    states.scratch = new_vec<u32>(16);
+    states.stack = new_vec<u32>(16);
+    states.set = new_sparse_set(prog->insts.len);
+    states.max_states = max_states;
+    states.max_keys = max_keys;
+    return states;
+}
+
+void Dfa::deinit()
+{
+    table.deinit();
+}
+
+// Runs from the encoded state 't' at 'n', returns the end of the last match
+u64 Dfa::run(u32 t, string expr, u64 n) const
+{
+    u64 match = t & Dfa_Accept ? n : npos;
+
+    for (; n < expr.len; n++) {
+        t = table.data[(t & ~0xffu) | (u8)expr.data[n]];
+        if (t >> 8 == Dfa_Dead)
+            break;
+        if (t & Dfa_Accept)
+            match = n + 1;
+    }
+    return match;
+}
+
+u64 Dfa::submit(string expr) const
+{
+    return run(start, expr, 0);
+}
+
+// End of the leftmost match starting at or after 'from'
+u64 Dfa::search(string expr, u64 from) const
+{
+    return run(unanchored, expr, from);
+}
+
+// One transition per byte class, the rows stay dense for matching. The
+// states are interned as 'step' reaches them, returns false when they do not
+// fit 'max_states'.
+bool make_dfa_table(Dfa_States *states, const Byte_Classes &classes, auto step, Vec<u32> *table)
+{
+    u8 bytes[256] = {};
+    for (u32 c = 256; c-- > 0;)
+        bytes[classes[c]] = c;
+
+    *table = new_vec<u32>(256 * 4);
+    u32 row[256] = {};
+    for (u32 state = 0; state < states->offsets.len; state++) {
+        for (u32 k = 0; k < classes.len; k++) {
+            row[k] = state != Dfa_Dead ? states->intern(step(state, bytes[k])) : Dfa_Dead;
+            if (row[k] == Dfa_Full) {
+                table->deinit();
+                return false;
+            }
+        }
+        for (u32 c = 0; c < 256; c++)
+            table->push(row[classes[c]]);
+    }
+
+    for (u32 &next : *table)
+        next = next << 8 | (states->accepts(next) != 0);
+    return true;
+}
+
+bool compile_dfa(const Prog *prog, Dfa *dfa, u32 max_states)
+{
+    if (prog->has_lookaround)
+        return false;
+
+    Dfa_States states = new_dfa_states(prog, max_states);
+    defer(states.deinit());
+
+    // the empty set without accept is the dead state
+    states.intern(0);
+    u32 start = states.intern(prog->closure(prog->start, &states.set, &states.stack));
+    states.set.clear();
+    u32 unanchored = states.intern(prog->closure(prog->unanchored, &states.set, &states.stack));
+    if (unanchored == Dfa_Full)
+        return false;
+
+    Vec<u32> table = {};
+    auto step = [&](u32 state, u8 c) { return states.step(state, c); };
+    if (!make_dfa_table(&states, prog->classes, step, &table))
+        return false;
+
+    u32 accept = states.accepts(start) != 0;
+    *dfa = Dfa{table, start << 8 | accept, unanchored << 8 | (states.accepts(unanchored) != 0), (u32)states.offsets.len};
+    return true;
+}
+
+// The set of a state are the instructions that can read the byte before the
+// ones read so far, the threads of the program are followed backward
+bool compile_reverse_dfa(const Prog *prog, const Reverse_Prog *reverse, Dfa *dfa, u32 max_states)
+{
+    if (prog->has_lookaround)
+        return false;
+
+    Dfa_States states = new_dfa_states(prog, max_states);
+    defer(states.deinit());
+
+    states.intern(0);
+    for (u32 pc = 0; pc < reverse->flags.len; pc++) {
+        if (reverse->flags[pc] & Reverse_Last)
+            states.set.insert(pc);
+    }
+    u32 start = states.intern(reverse->empty);
+    if (start == Dfa_Full)
+        return false;
+
+    auto step = [&](u32 state, u8 c) {
+        states.set.clear();
+        u32 accept = 0;
+        u32 offset = states.offsets[state];
+        for (u32 i = 0; i < states.keys[offset + 1]; i++) {
+            u32 pc = states.keys[offset + 2 + i];
+            if (!prog->insts[pc].step(c))
+                continue;
+            accept |= reverse->flags[pc] & Reverse_First;
+            for (u32 j = reverse->offsets[pc]; j < reverse->offsets[pc + 1]; j++)
+                states.set.insert(reverse->preds[j]);
+        }
+        return accept;
+    };
+    Vec<u32> table = {};
+    if (!make_dfa_table(&states, prog->classes, step, &table))
+        return false;
+
+    u32 t = start << 8 | (states.accepts(start) != 0);
+    *dfa = Dfa{table, t, t, (u32)states.offsets.len};
+    return true;
+}
+
+// Moore partition refinement, states are first split by accept then by the
+// classes their transitions reach, until a round splits no class. The
+// classes are numbered by their first state so the dead state stays 0.
+Dfa minimize_dfa(const Dfa *dfa)
+{
+    const u32 Sig_Len = 257;
+    u32 len = dfa->len;
+
+    Vec<u32> classes = new_vec<u32>(len);
+    classes.reserve_with(len, 0);
+    classes.len = len;
+    for (u32 t : dfa->table)
+        classes[t >> 8] = t & Dfa_Accept;
+    classes[dfa->start >> 8] = dfa->start & Dfa_Accept;
+    classes[dfa->unanchored >> 8] = dfa->unanchored & Dfa_Accept;
+
+    u32 slots_len = 1;
+    while (slots_len < len * 2)
+        slots_len *= 2;
+
+    Vec<u32> next_classes = new_vec<u32>(len);
+    Vec<u32> sigs = new_vec<u32>(len * Sig_Len);
+    Vec<u32> slots = new_vec<u32>(slots_len);
+    next_classes.len = len, sigs.len = len * Sig_Len, slots.len = slots_len;
+    defer(classes.deinit(); next_classes.deinit(); sigs.deinit(); slots.deinit());
+
+    u32 count = 0;
+    for (;;) {
+        u32 next_count = 0;
+        u32 mask = slots_len - 1;
+        memset(slots.data, 0, slots_len * sizeof(u32));
+
+        for (u32 state = 0; state < len; state++) {
+            u32 *sig = &sigs[state * Sig_Len];
+            sig[0] = classes[state];
+            for (u32 c = 0; c < 256; c++)
+                sig[c + 1] = classes[dfa->table[state << 8 | c] >> 8];
+
+            for (u32 i = hash_key(sig, Sig_Len) & mask;; i = (i + 1) & mask) {
+                if (slots[i] == 0) {
+                    slots[i] = state + 1;
+                    next_classes[state] = next_count++;
+                    break;
+                }
+                u32 other = slots[i] - 1;
+                if (!memcmp(sig, &sigs[other * Sig_Len], Sig_Len * sizeof(u32))) {
+                    next_classes[state] = next_classes[other];
+                    break;
+                }
+            }
+        }
+
+        Vec<u32> swap = classes;
+        classes = next_classes, next_classes = swap;
+        if (next_count == count)
+            break;
+        count = next_count;
+    }
+
+    // the first state of a class gives its row
+    Vec<u32> table = new_vec<u32>(count * 256);
+    for (u32 state = 0, rows = 0; state < len; state++) {
+        if (classes[state] != rows)
+            continue;
+        for (u32 c = 0; c < 256; c++) {
+            u32 t = dfa->table[state << 8 | c];
+            table.push(classes[t >> 8] << 8 | (t & Dfa_Accept));
+        }
+        rows++;
+    }
+
+    u32 start = classes[dfa->start >> 8] << 8 | (dfa->start & Dfa_Accept);
+    u32 unanchored = classes[dfa->unanchored >> 8] << 8 | (dfa->unanchored & Dfa_Accept);
+    return Dfa{table, start, unanchored, count};
+}
+
+// Computes the missing transition of the encoded state 't' on 'c'
+u32 Lazy_Dfa_Cache::transition(u32 t, u8 c)
+{
+    u32 state = t >> 8;
+    u32 accept = states.step(state, c);
+    u32 next = states.intern(accept);
+    bool flushed = next == Dfa_Full;
+
+    if (flushed) {
+        flush();
+        next = states.intern(accept);
+        Assert(next != Dfa_Full, "lazy dfa cache is too small");
+    }
+
+    if (next == table.len / 256) {
+        for (u32 i = 0; i < 256; i++)
+            table.push(Dfa_Unknown);
+    }
+
+    // 'state' does not survive a flush, its row is not updated
+    if (!flushed) {
+        const Byte_Classes &classes = prog.classes;
+        for (u32 b = 0; b < 256; b++) {
+            if (classes[b] == classes[c])
+                table[state << 8 | b] = next << 8 | (accept != 0);
+        }
+    }
+    return next << 8 | (accept != 0);
+}
+
+void Lazy_Dfa_Cache::flush()
+{
+    states.truncate(permanent);
+    table.len = permanent * 256;
+    for (u32 i = 256; i < table.len; i++)
+        table[i] = Dfa_Unknown;
+    stats.flushes++;
+}
+
+void Lazy_Dfa::deinit()
+{
+    if (!cache)
+        return;
+    cache->states.deinit();
+    cache->table.deinit();
+    delete cache;
+}
+
+// Sets 'accept' to the accept of the last match
+u64 Lazy_Dfa::run(u32 t, string expr, u64 n, u32 *accept) const
+{
+    u64 match = npos;
+    u64 misses = 0;
+    u64 from = n;
+
+    if (t & Dfa_Accept) {
+        match = n;
+        if (accept)
+            *accept = cache->states.accepts(t >> 8);
+    }
+
+    for (; n < expr.len; n++) {
+        u32 next = cache->table.data[(t & ~0xffu) | (u8)expr.data[n]];
+        if (next == Dfa_Unknown)
+            next = cache->transition(t, expr.data[n]), misses++;
+
+        t = next;
+        if (t >> 8 == Dfa_Dead)
+            break;
+        if (t & Dfa_Accept) {
+            match = n + 1;
+            if (accept)
+                *accept = cache->states.accepts(t >> 8);
+        }
+    }
+
+    cache->stats.misses += misses;
+    cache->stats.hits += Min(n + 1, expr.len) - from - misses;
+    return match;
+}
+
+u64 Lazy_Dfa::submit(string expr) const
+{
+    return run(cache->start, expr, 0);
+}
+
+u64 Lazy_Dfa::search(string expr, u64 from) const
+{
+    return run(cache->unanchored, expr, from);
+}
+
+Lazy_Dfa_Stats Lazy_Dfa::stats() const
+{
+    Lazy_Dfa_Stats stats = cache->stats;
+    stats.states = cache->states.offsets.len;
+    stats.size = cache->states.size() + cache->table.cap * sizeof(u32);
+    return stats;
+}
+
+bool compile_lazy_dfa(const Prog *prog, Lazy_Dfa *lazy_dfa, size_t cache_size)
+{
+    if (prog->has_lookaround)
+        return false;
+
+    // 3/4 of the budget goes to the transition rows, the rest to the keys
+    const size_t row_size = 257 * sizeof(u32);
+    u32 max_states = Max(cache_size * 3 / 4 / row_size, 4);
+    size_t max_keys = cache_size / 4 / sizeof(u32);
+
+    auto cache = new Lazy_Dfa_Cache{};
+    cache->prog = *prog;
+    cache->states = new_dfa_states(&cache->prog, max_states);
+    cache->table = new_vec<u32>(256 * 4);
+
+    cache->states.intern(0);
+    u32 accept = prog->closure(prog->start, &cache->states.set, &cache->states.stack);
+    u32 start = cache->states.intern(accept);
+    cache->start = start << 8 | (accept != 0);
+
+    cache->states.set.clear();
+    accept = prog->closure(prog->unanchored, &cache->states.set, &cache->states.stack);
+    u32 unanchored = cache->states.intern(accept);
+    cache->unanchored = unanchored << 8 | (accept != 0);
+    cache->permanent = cache->states.offsets.len;
+
+    // the permanent states and any new state always fit after a flush
+    cache->states.max_keys = Max(max_keys, cache->states.keys.len + prog->insts.len + 2);
+    for (u32 i = 0; i < cache->permanent * 256; i++)
+        cache->table.push(i < 256 ? Dfa_Dead : Dfa_Unknown);
+
+    *lazy_dfa = Lazy_Dfa{cache};
+    return true;
+}
+
+} // namespace bee::regex
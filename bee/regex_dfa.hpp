@@ -0,0 +1,105 @@
+#ifndef BEE_REGEX_DFA_HPP
+#define BEE_REGEX_DFA_HPP
+
+#include "regex_prog.hpp"
+
+namespace bee::regex
+{
+
+const u32 Dfa_Dead = 0;
+const u32 Dfa_Accept = 1;
+const u32 Dfa_Full = (u32)-1;
+const u32 Dfa_Unknown = (u32)-1;
+const u32 Dfa_Max_States = 4096;
+
+// Dfa states are keyed by the ordered list of consuming instructions of the
+// program, keys are stored as [accept, len, pc...] in one buffer. The accept
+// of a merged program is its first matching rule + 1.
+struct Dfa_States
+{
+    const Prog *prog;
+    Vec<u32> keys;
+    Vec<u32> offsets;
+    Vec<u32> slots;
+    Vec<u32> scratch;
+    Vec<u32> stack;
+    Sparse_Set set;
+    u32 max_states;
+    size_t max_keys;
+
+    void deinit();
+    u32 intern(u32 accept);
+    u32 step(u32 state, u8 c);
+    u32 accepts(u32 state) const;
+    void truncate(u32 len);
+    size_t size() const;
+};
+
+Dfa_States new_dfa_states(const Prog *prog, u32 max_states, size_t max_keys = npos);
+
+// Dense deterministic automaton built by subset construction over a
+// lookaround free program. Transitions are stored as (state << 8 | accept)
+// so the next row is found from the previous transition with one lookup.
+struct Dfa
+{
+    Vec<u32> table;
+    u32 start;
+    u32 unanchored;
+    u32 len;
+
+    void deinit();
+    u64 run(u32 t, string expr, u64 n) const;
+    u64 submit(string expr) const;
+    u64 search(string expr, u64 from) const;
+};
+
+bool compile_dfa(const Prog *prog, Dfa *dfa, u32 max_states = Dfa_Max_States);
+// Reads the input backward from the end of a match, a state accepts when a
+// match starts right before the last byte read, the start when it can be empty
+bool compile_reverse_dfa(const Prog *prog, const Reverse_Prog *reverse, Dfa *dfa, u32 max_states = Dfa_Max_States);
+// Merges the states that no input tells apart, the dead state stays first
+Dfa minimize_dfa(const Dfa *dfa);
+
+// Lazy Dfa, states are built when the input reaches them and kept in a
+// cache bounded by 'cache_size' bytes, the cache is flushed when it fills.
+const size_t Lazy_Dfa_Cache_Size = 1 << 20;
+
+struct Lazy_Dfa_Stats
+{
+    u64 hits;
+    u64 misses;
+    u64 flushes;
+    u32 states;
+    size_t size;
+};
+
+struct Lazy_Dfa_Cache
+{
+    Prog prog;
+    Dfa_States states;
+    Vec<u32> table;
+    u32 start;
+    u32 unanchored;
+    u32 permanent;
+    Lazy_Dfa_Stats stats;
+
+    u32 transition(u32 t, u8 c);
+    void flush();
+};
+
+struct Lazy_Dfa
+{
+    Lazy_Dfa_Cache *cache;
+
+    void deinit();
+    u64 run(u32 t, string expr, u64 n, u32 *accept = NULL) const;
+    u64 submit(string expr) const;
+    u64 search(string expr, u64 from) const;
+    Lazy_Dfa_Stats stats() const;
+};
+
+bool compile_lazy_dfa(const Prog *prog, Lazy_Dfa *lazy_dfa, size_t cache_size = Lazy_Dfa_Cache_Size);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,269 @@
+#include "regex_glushkov.hpp"
+
+namespace bee::regex
+{
+
+void Glushkov::deinit()
+{
+    follows.deinit();
+    follow_chunks.deinit();
+    preds.deinit();
+    pred_chunks.deinit();
+    alts.deinit();
+    offsets.deinit();
+}
+
+u64 Glushkov::follow(u64 threads) const
+{
+    u64 next = threads << 1 & shift;
+    for (size_t i = 0; i < follow_chunks.len; i++) {
+        u32 k = follow_chunks.data[i];
+        next |= follows.data[i << 8 | (threads >> (k * 8) & 0xff)];
+    }
+    return next;
+}
+
+u64 Glushkov::pred(u64 threads) const
+{
+    u64 prev = (threads & shift) >> 1;
+    for (size_t i = 0; i < pred_chunks.len; i++) {
+        u32 k = pred_chunks.data[i];
+        prev |= preds.data[i << 8 | (threads >> (k * 8) & 0xff)];
+    }
+    return prev;
+}
+
+u64 Glushkov::submit(string expr, Vec<u64> *lives) const
+{
+    const u8 *data = (const u8 *)expr.data;
+
+    // the threads only tell whether a match ends at a byte, while there is
+    // one thread at a time its path is the only one and ends last
+    u64 end = empty ? 0 : npos;
+    u64 threads = 0;
+    u64 crowded = 0;
+    for (u64 n = 0; n < expr.len; n++) {
+        threads = (n == 0 ? first : follow(threads)) & masks[data[n]];
+        if (!threads)
+            break;
+        crowded |= threads & (threads - 1);
+        if (threads & accepts)
+            end = n + 1;
+    }
+    if (end == npos or end == 0 or !crowded)
+        return end;
+
+    // live[n] are the threads on byte n from which a match ends by 'end',
+    // the buffer is kept from one input to the next
+    lives->reserve(end);
+    u64 *live = lives->data;
+
+    live[end - 1] = masks[data[end - 1]] & accepts;
+    for (u64 n = end - 1; n-- > 0;)
+        live[n] = masks[data[n]] & (accepts | pred(live[n + 1]));
+
+    const u8 *alt = alts.data + offsets[len];
+    const u8 *alts_end = alts.data + offsets[len + 1];
+    for (u64 n = 0;; n++) {
+        for (; alt < alts_end; alt++) {
+            if (*alt == Glushkov_Match)
+                return n;
+            if (n < end and live[n] >> *alt & 1)
+                break;
+        }
+        if (alt == alts_end)
+            return npos;
+        u32 p = *alt;
+        alt = alts.data + offsets[p], alts_end = alts.data + offsets[p + 1];
+    }
+}
+
+// Threads are grouped by the offset they started at, a thread that reaches
+// a position held by an older group is dropped as the older start wins. The
+// groups hold disjoint positions so there are at most 64 of them. Once a
+// group accepts no new start is taken and the younger groups are dropped,
+// the leftmost start is known when the older ones die out.
+u64 Glushkov::search(string expr, u64 from, u64 *begin, Vec<u64> *lives) const
+{
+    struct Group
+    {
+        u64 start;
+        u64 threads;
+    };
+    const u8 *data = (const u8 *)expr.data;
+    Group groups[Glushkov_Positions];
+    u32 len = 0;
+    u64 start = empty ? from : npos;
+
+    for (u64 n = from; n < expr.len and (start == npos or len > 0); n++) {
+        u64 mask = masks[data[n]];
+        u64 claimed = 0;
+        u32 alive = 0;
+        for (u32 i = 0; i < len; i++) {
+            u64 threads = follow(groups[i].threads) & mask & ~claimed;
+            if (threads)
+                claimed |= threads, groups[alive++] = {groups[i].start, threads};
+        }
+        len = alive;
+        if (start == npos and (first & mask & ~claimed))
+            groups[len++] = {n, first & mask & ~claimed};
+
+        for (u32 i = 0; i < len; i++) {
+            if (groups[i].threads & accepts) {
+                start = groups[i].start, len = i;
+                break;
+            }
+        }
+    }
+    if (start == npos)
+        return npos;
+
+    *begin = start;
+    return start + submit(expr.begin_at(&expr.data[start]), lives);
+}
+
+// Alternatives reached from 'pc' in priority order, the ones after the
+// match are cut
+void push_alts(const Prog *prog, const u32 *positions, u32 pc, Sparse_Set *set, Vec<u32> *stack, Vec<u8> *alts)
+{
+    set->clear();
+    stack->len = 0;
+    stack->push(pc);
+
+    while (!stack->empty()) {
+        pc = stack->pop();
+        if (!set->insert(pc))
+            continue;
+
+        const Inst &inst = prog->insts[pc];
+        switch (inst.op) {
+        case Op_Match:
+            alts->push(Glushkov_Match);
+            return;
+        case Op_Jump:
+            stack->push(inst.x);
+            break;
+        case Op_Split:
+            stack->push(inst.y);
+            stack->push(inst.x);
+            break;
+        case Op_Any:
+        case Op_Range:
+        case Op_Set:
+            alts->push(positions[pc]);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Rows of 256 for the chunks of 8 positions that have an edge in 'edges'
+void make_chunks(const u64 *edges, u32 len, Vec<u64> *rows, Vec<u8> *chunks)
+{
+    for (u32 k = 0; k * 8 < len; k++) {
+        u64 any = 0;
+        for (u32 j = 0; j < 8 and k * 8 + j < len; j++)
+            any |= edges[k * 8 + j];
+        if (!any)
+            continue;
+
+        chunks->push(k);
+        for (u32 b = 0; b < 256; b++) {
+            u64 row = 0;
+            for (u32 j = 0; j < 8 and k * 8 + j < len; j++) {
+                if (b >> j & 1)
+                    row |= edges[k * 8 + j];
+            }
+            rows->push(row);
+        }
+    }
+}
+
+bool compile_glushkov(const Prog *prog, Glushkov *glushkov)
+{
+    if (prog->has_lookaround or prog->rules != 0)
+        return false;
+
+    Sparse_Set set = new_sparse_set(prog->insts.len);
+    Vec<u32> stack = new_vec<u32>(16);
+    defer(set.deinit(); stack.deinit());
+
+    // only the instructions reached from the start are positions, the
+    // unanchored loop and the nodes folded by the parser are not
+    stack.push(prog->start);
+    while (!stack.empty()) {
+        u32 pc = stack.pop();
+        const Inst &inst = prog->insts[pc];
+        if (!set.insert(pc) or inst.op == Op_Match or inst.op == Op_Fail)
+            continue;
+        stack.push(inst.x);
+        if (inst.op == Op_Split)
+            stack.push(inst.y);
+    }
+
+    u32 len = 0;
+    Vec<u32> positions = new_vec<u32>(prog->insts.len);
+    defer(positions.deinit());
+    positions.reserve_with(prog->insts.len, Glushkov_Match);
+    positions.len = prog->insts.len;
+    for (u32 pc = 0; pc < prog->insts.len; pc++) {
+        if (set.has(pc) and prog->insts[pc].consumes())
+            positions[pc] = len++;
+    }
+    if (len > Glushkov_Positions)
+        return false;
+
+    Glushkov g = {};
+    g.len = len;
+    g.alts = new_vec<u8>(len * 2);
+    g.offsets = new_vec<u32>(len + 2);
+
+    u64 edges[Glushkov_Positions] = {};
+    for (u32 pc = 0; pc < prog->insts.len; pc++) {
+        const Inst &inst = prog->insts[pc];
+        if (positions[pc] == Glushkov_Match)
+            continue;
+
+        u32 p = positions[pc];
+        g.offsets.push(g.alts.len);
+        push_alts(prog, positions.data, inst.x, &set, &stack, &g.alts);
+        for (u32 i = g.offsets[p]; i < g.alts.len; i++) {
+            if (g.alts[i] == Glushkov_Match)
+                g.accepts |= (u64)1 << p;
+            else
+                edges[p] |= (u64)1 << g.alts[i];
+        }
+        for (u32 c = 0; c < 256; c++)
+            g.masks[c] |= (u64)inst.step(c) << p;
+    }
+
+    g.offsets.push(g.alts.len);
+    push_alts(prog, positions.data, prog->start, &set, &stack, &g.alts);
+    g.offsets.push(g.alts.len);
+    for (u32 i = g.offsets[len]; i < g.alts.len; i++) {
+        if (g.alts[i] == Glushkov_Match)
+            g.empty = true;
+        else
+            g.first |= (u64)1 << g.alts[i];
+    }
+
+    // p follows p - 1 with a shift, the other edges go to the rows
+    u64 preds[Glushkov_Positions] = {};
+    for (u32 p = 0; p < len; p++) {
+        u64 next = p + 1 < len ? (u64)1 << (p + 1) : 0;
+        if (edges[p] & next)
+            g.shift |= next, edges[p] &= ~next;
+        for (u32 q = 0; q < len; q++) {
+            if (edges[p] >> q & 1)
+                preds[q] |= (u64)1 << p;
+        }
+    }
+    make_chunks(edges, len, &g.follows, &g.follow_chunks);
+    make_chunks(preds, len, &g.preds, &g.pred_chunks);
+
+    *glushkov = g;
+    return true;
+}
+
+} // namespace bee::regex
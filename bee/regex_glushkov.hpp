@@ -0,0 +1,50 @@
+#ifndef BEE_REGEX_GLUSHKOV_HPP
+#define BEE_REGEX_GLUSHKOV_HPP
+
+#include "regex_prog.hpp"
+
+namespace bee::regex
+{
+
+// Position automaton of a lookaround free program of at most 64 consuming
+// instructions, the threads alive after a byte are the bits of one u64 and
+// a step is the follow of the threads and the mask of the byte. Position p
+// mostly follows p - 1, that edge is a shift, the others are looked up from
+// rows of 256 indexed by 8 positions at a time.
+//
+// A set forgets the priority of its threads. While one thread is alive at a
+// time the match ends where it last accepts, otherwise it takes two more
+// passes: backward to the threads that can still end a match at every byte,
+// then forward along the first live alternative of each step, which is the
+// path of the backtracker. The live threads of every byte are kept in
+// 'lives', a buffer of the caller's scratch.
+const u32 Glushkov_Positions = 64;
+const u8 Glushkov_Match = 0xff;
+
+struct Glushkov
+{
+    u64 masks[256];
+    u64 first;
+    u64 accepts;
+    u64 shift;
+    bool empty;
+    u32 len;
+    Vec<u64> follows;
+    Vec<u8> follow_chunks;
+    Vec<u64> preds;
+    Vec<u8> pred_chunks;
+    Vec<u8> alts; // alternatives of every position then of the start, in priority order
+    Vec<u32> offsets;
+
+    void deinit();
+    u64 follow(u64 threads) const;
+    u64 pred(u64 threads) const;
+    u64 submit(string expr, Vec<u64> *lives) const;
+    u64 search(string expr, u64 from, u64 *begin, Vec<u64> *lives) const;
+};
+
+bool compile_glushkov(const Prog *prog, Glushkov *glushkov);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,261 @@
+#include "regex_image.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bee::regex
+{
+
+void Regex_Image::deinit()
+{
+    if (mapped != 0)
+        munmap((void *)header, mapped);
+    *this = {};
+}
+
+// Runs from the transition 't' at 'n', returns the end of the last match
+u64 Regex_Image::run(u32 t, string expr, u64 n) const
+{
+    u64 match = t & 1 ? n : npos;
+
+    for (; n < expr.len; n++) {
+        t = table[(t >> 1) + classes[(u8)expr.data[n]]];
+        if (t >> 1 == 0)
+            break;
+        if (t & 1)
+            match = n + 1;
+    }
+    return match;
+}
+
+Match Regex_Image::match(string expr) const
+{
+    return new_match(expr, run(header->start, expr, 0));
+}
+
+// Runs the reverse Dfa back from 'end', returns the leftmost start of a match
+// ending there
+u64 Regex_Image::run_reverse(string expr, u64 end) const
+{
+    u32 t = header->reverse_start;
+    u64 begin = t & 1 ? end : npos;
+
+    for (u64 n = end; n > 0; n--) {
+        t = reverse[(t >> 1) + classes[(u8)expr.data[n - 1]]];
+        if (t >> 1 == 0)
+            break;
+        if (t & 1)
+            begin = n - 1;
+    }
+    return begin;
+}
+
+// The unanchored run tells whether there is a match and where it ends, the
+// reverse run finds its start
+Match Regex_Image::find(string haystack) const
+{
+    u64 end = run(header->unanchored, haystack, 0);
+    if (end == npos)
+        return new_match(haystack, npos);
+
+    u64 begin = run_reverse(haystack, end);
+    return new_match(haystack.begin_at(&haystack.data[begin]), end - begin);
+}
+
+// Bytes whose column is the same in every row of both automata share a class
+u32 make_image_classes(const Dfa *dfa, const Dfa *reverse, u8 *classes, u8 *firsts)
+{
+    const Dfa *dfas[] = {dfa, reverse};
+    auto same = [&](u32 a, u32 b) {
+        for (const Dfa *it : dfas) {
+            for (u32 state = 0; state < it->len; state++) {
+                if (it->table[state << 8 | a] != it->table[state << 8 | b])
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    u32 hashes[256];
+    for (u32 c = 0; c < 256; c++) {
+        u32 h = 2166136261u;
+        for (const Dfa *it : dfas) {
+            for (u32 state = 0; state < it->len; state++)
+                h = (h ^ it->table[state << 8 | c]) * 16777619u;
+        }
+        hashes[c] = h;
+    }
+
+    u32 stride = 0;
+    for (u32 c = 0; c < 256; c++) {
+        u32 k = 0;
+        while (k < stride and (hashes[firsts[k]] != hashes[c] or !same(firsts[k], c)))
+            k++;
+        if (k == stride)
+            firsts[stride++] = c;
+        classes[c] = k;
+    }
+    return stride;
+}
+
+
+u32 encode_image_transition(u32 t, u32 stride)
+{
+    return (t >> 8) * stride << 1 | (t & Dfa_Accept);
+}
+
+void encode_image_table(const Dfa *dfa, const u8 *firsts, u32 stride, Vec<char> *buf)
+{
+    for (u32 state = 0; state < dfa->len; state++) {
+        for (u32 k = 0; k < stride; k++) {
+            u32 t = encode_image_transition(dfa->table[state << 8 | firsts[k]], stride);
+            buf->concat((const char *)&t, (const char *)(&t + 1));
+        }
+    }
+}
+
+// Appends the image of 'regex' to 'buf', its Dfa is compiled when the regex
+// runs another engine
+bool encode_regex_image(const Regex *regex, Vec<char> *buf)
+{
+    Prog prog = {};
+    Reverse_Prog reverse_prog = {};
+    Dfa compiled = {};
+    Dfa reverse = {};
+    defer(prog.deinit());
+    defer(reverse_prog.deinit());
+    defer(compiled.deinit());
+    defer(reverse.deinit());
+
+    const Dfa *dfa = &regex->dfa;
+    if (regex->engine != Engine_Dfa) {
+        prog = compile_prog(&regex->arena, regex->node_head);
+        if (!compile_dfa(&prog, &compiled))
+            return false;
+        dfa = &compiled;
+    }
+    const Prog *forward = regex->engine == Engine_Dfa ? &regex->prog : &prog;
+    reverse_prog = compile_reverse_prog(forward);
+    if (!compile_reverse_dfa(forward, &reverse_prog, &reverse))
+        return false;
+
+    Dfa min = minimize_dfa(dfa);
+    Dfa reverse_min = minimize_dfa(&reverse);
+    defer(min.deinit());
+    defer(reverse_min.deinit());
+
+    u8 classes[256];
+    u8 firsts[256];
+    u32 stride = make_image_classes(&min, &reverse_min, classes, firsts);
+
+    Image_Header header = {};
+    memcpy(header.magic, Image_Magic, sizeof(Image_Magic));
+    header.version = Image_Version;
+    header.order = Image_Order;
+    header.classes = sizeof(Image_Header);
+    header.table = header.classes + sizeof(classes);
+    header.reverse = header.table + min.len * stride * sizeof(u32);
+    header.source = header.reverse + reverse_min.len * stride * sizeof(u32);
+    header.source_len = regex->source.len;
+    header.size = header.source + header.source_len + 1;
+    header.states = min.len;
+    header.stride = stride;
+    header.start = encode_image_transition(min.start, stride);
+    header.unanchored = encode_image_transition(min.unanchored, stride);
+    header.reverse_states = reverse_min.len;
+    header.reverse_start = encode_image_transition(reverse_min.start, stride);
+
+    buf->reserve(buf->len + header.size);
+    buf->concat((const char *)&header, (const char *)(&header + 1));
+    buf->concat((const char *)classes, (const char *)(classes + sizeof(classes)));
+    encode_image_table(&min, firsts, stride, buf);
+    encode_image_table(&reverse_min, firsts, stride, buf);
+    if (!regex->source.empty())
+        buf->concat(regex->source.begin(), regex->source.end());
+    buf->push('\0');
+    return true;
+}
+
+bool write_regex_image(const Regex *regex, const char *path)
+{
+    Vec<char> buf = new_vec<char>(4096);
+    defer(buf.deinit());
+    if (!encode_regex_image(regex, &buf))
+        return false;
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(buf.data, 1, buf.len, f) == buf.len;
+    return fclose(f) == 0 and ok;
+}
+
+// Every offset and transition is checked once, matching does not check them again
+bool view_regex_image(string bytes, Regex_Image *image)
+{
+    if (bytes.len < sizeof(Image_Header) or (uintptr_t)bytes.data % alignof(Image_Header) != 0)
+        return false;
+
+    auto header = (const Image_Header *)bytes.data;
+    if (memcmp(header->magic, Image_Magic, sizeof(Image_Magic)) or header->version != Image_Version or
+        header->order != Image_Order or header->size > bytes.len)
+        return false;
+
+    u64 rows = (u64)header->states * header->stride;
+    u64 reverse_rows = (u64)header->reverse_states * header->stride;
+    if (header->states == 0 or header->reverse_states == 0 or header->stride == 0 or header->stride > 256 or
+        header->table % sizeof(u32) != 0 or header->reverse % sizeof(u32) != 0 or
+        (u64)header->classes + 256 > header->size or header->table + rows * sizeof(u32) > header->size or
+        header->reverse + reverse_rows * sizeof(u32) > header->size or
+        (u64)header->source + header->source_len > header->size)
+        return false;
+
+    auto classes = (const u8 *)&bytes.data[header->classes];
+    auto table = (const u32 *)&bytes.data[header->table];
+    auto reverse = (const u32 *)&bytes.data[header->reverse];
+    auto valid = [&](u32 t, u64 len) { return (t >> 1) < len and (t >> 1) % header->stride == 0; };
+
+    for (u32 c = 0; c < 256; c++) {
+        if (classes[c] >= header->stride)
+            return false;
+    }
+    for (u64 i = 0; i < rows; i++) {
+        if (!valid(table[i], rows))
+            return false;
+    }
+    for (u64 i = 0; i < reverse_rows; i++) {
+        if (!valid(reverse[i], reverse_rows))
+            return false;
+    }
+    if (!valid(header->start, rows) or !valid(header->unanchored, rows) or !valid(header->reverse_start, reverse_rows))
+        return false;
+
+    *image = Regex_Image{header, classes, table, reverse, {&bytes.data[header->source], header->source_len}, 0};
+    return true;
+}
+
+bool open_regex_image(const char *path, Regex_Image *image)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    defer(close(fd));
+
+    struct stat st = {};
+    if (fstat(fd, &st) < 0 or st.st_size == 0)
+        return false;
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        return false;
+
+    if (!view_regex_image(string{(const char *)data, (size_t)st.st_size}, image)) {
+        munmap(data, st.st_size);
+        return false;
+    }
+    image->mapped = st.st_size;
+    return true;
+}
+
+} // namespace bee::regex
@@ -0,0 +1,66 @@
+#ifndef BEE_REGEX_IMAGE_HPP
+#define BEE_REGEX_IMAGE_HPP
+
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+// Compiled regexes saved to disk and matched in place. An image holds the
+// minimized Dfa of the regex and the one of its reverse program over shared
+// byte classes, and the pattern source. Every reference is an offset so the
+// bytes are used as they are mapped:
+//
+//   header | classes[256] | table[states * stride] | reverse[reverse_states * stride] | source
+//
+// A transition is (row offset << 1 | accept), the dead state is row 0.
+// Images are in the byte order of the host that wrote them, 'order' tells
+// them apart. Lookaround and patterns past Dfa_Max_States have no image.
+const char Image_Magic[8] = {'b', 'e', 'e', 'r', 'e', 'g', 'e', 'x'};
+const u32 Image_Version = 2;
+const u32 Image_Order = 0x01020304;
+
+struct Image_Header
+{
+    char magic[8];
+    u32 version;
+    u32 order;
+    u32 size; // bytes of the whole image
+    u32 classes;
+    u32 table;
+    u32 source;
+    u32 source_len;
+    u32 states;
+    u32 stride; // byte classes, transitions per row
+    u32 start;
+    u32 unanchored;
+    u32 reverse;
+    u32 reverse_states;
+    u32 reverse_start;
+};
+
+struct Regex_Image
+{
+    const Image_Header *header;
+    const u8 *classes;
+    const u32 *table;
+    const u32 *reverse;
+    string source;
+    size_t mapped; // bytes mapped by open_regex_image(), 0 for a view
+
+    void deinit();
+    u64 run(u32 t, string expr, u64 n) const;
+    u64 run_reverse(string expr, u64 end) const;
+    Match match(string expr) const;
+    Match find(string haystack) const;
+};
+
+bool encode_regex_image(const Regex *regex, Vec<char> *buf);
+bool write_regex_image(const Regex *regex, const char *path);
+// 'bytes' are checked then used in place, they must outlive the image and be 4 bytes aligned
+bool view_regex_image(string bytes, Regex_Image *image);
+bool open_regex_image(const char *path, Regex_Image *image);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,95 @@
+#include "regex_lexer.hpp"
+
+namespace bee::regex
+{
+
+void Lexer::deinit()
+{
+    kinds.deinit();
+    prog.deinit();
+    for (size_t i = 0; i < regexes.len; i++) {
+        regexes[i]->deinit();
+        delete regexes[i];
+    }
+    regexes.deinit();
+}
+
+void Lexer_Scratch::deinit()
+{
+    lazy_dfa.deinit();
+    for (size_t i = 0; i < scratches.len; i++)
+        scratches[i].deinit();
+    scratches.deinit();
+}
+
+Lexer_Scratch new_lexer_scratch(const Lexer *lexer)
+{
+    Lexer_Scratch scratch = {};
+    if (lexer->regexes.empty()) {
+        compile_lazy_dfa(&lexer->prog, &scratch.lazy_dfa, lexer->cache_size);
+        return scratch;
+    }
+
+    scratch.scratches = new_vec<Scratch>(lexer->regexes.len);
+    for (size_t i = 0; i < lexer->regexes.len; i++)
+        scratch.scratches.push(new_scratch(lexer->regexes[i]));
+    return scratch;
+}
+
+Token Lexer::next(string expr, Lexer_Scratch *scratch) const
+{
+    u64 len = npos;
+    u32 rule = 0;
+
+    if (regexes.empty()) {
+        const Lazy_Dfa &lazy_dfa = scratch->lazy_dfa;
+        len = lazy_dfa.run(lazy_dfa.cache->start, expr, 0, &rule);
+        rule--;
+    } else {
+        for (u32 i = 0; i < regexes.len; i++) {
+            Match match = regexes[i]->match(expr, &scratch->scratches[i]);
+            if (match.ok and (len == npos or match.view.len > len))
+                len = match.view.len, rule = i;
+        }
+    }
+
+    if (len == npos or len == 0)
+        return Token{false, 0, {expr.data, expr.data}, expr};
+    return Token{true, kinds[rule], {expr.data, expr.data + len}, {expr.data + len, expr.end()}};
+}
+
+Lexer compile_lexer(View<Lexer_Rule> rules, size_t cache_size)
+{
+    Lexer lexer = {};
+    lexer.kinds = new_vec<u32>(rules.len + 1);
+    lexer.regexes = new_vec<Regex *>(rules.len + 1);
+    lexer.cache_size = cache_size;
+
+    Vec<Prog> progs = new_vec<Prog>(rules.len + 1);
+    defer(progs.deinit());
+
+    for (size_t i = 0; i < rules.len; i++) {
+        Regex *regex = new Regex(compile_regex(rules[i].source));
+        lexer.kinds.push(rules[i].kind);
+        lexer.regexes.push(regex);
+        progs.push(compile_prog(&regex->arena, regex->node_head));
+    }
+
+    lexer.prog = merge_progs(View<Prog>{progs.data, progs.len});
+    for (Prog &prog : progs)
+        prog.deinit();
+
+    // the lazy Dfa does not run lookarounds
+    if (lexer.prog.has_lookaround)
+        return lexer;
+
+    // the regexes are only kept to try the rules one by one
+    for (size_t i = 0; i < lexer.regexes.len; i++) {
+        lexer.regexes[i]->deinit();
+        delete lexer.regexes[i];
+    }
+    lexer.regexes.len = 0;
+    return lexer;
+}
+
+} // namespace bee::regex
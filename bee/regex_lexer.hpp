@@ -0,0 +1,56 @@
+#ifndef BEE_REGEX_LEXER_HPP
+#define BEE_REGEX_LEXER_HPP
+
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+// Longest match over an ordered list of rules in one pass, every rule
+// matches as Regex::match would and the earliest rule wins a tie. The rules
+// run side by side in the lazy Dfa of their merged program, a rule with
+// lookaround makes the lexer try the rules one after another.
+//
+// Lexing does not change a compiled lexer, so the threads share one, each
+// with its own Lexer_Scratch for the states of the lazy Dfa or the scratch of
+// every rule.
+struct Lexer_Rule
+{
+    u32 kind;
+    string source;
+};
+
+// Empty matches are not tokens, the lexer would not move
+struct Token
+{
+    bool ok;
+    u32 kind;
+    string view;
+    string next;
+};
+
+struct Lexer_Scratch
+{
+    Lazy_Dfa lazy_dfa;
+    Vec<Scratch> scratches;
+
+    void deinit();
+};
+
+struct Lexer
+{
+    Vec<u32> kinds;
+    Prog prog;
+    Vec<Regex *> regexes;
+    size_t cache_size;
+
+    void deinit();
+    Token next(string expr, Lexer_Scratch *scratch) const;
+};
+
+Lexer_Scratch new_lexer_scratch(const Lexer *lexer);
+Lexer compile_lexer(View<Lexer_Rule> rules, size_t cache_size = Lazy_Dfa_Cache_Size);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,178 @@
+#include "regex_parallel.hpp"
+
+namespace bee::regex
+{
+
+const u32 Lane_Root = (u32)-1;
+
+// A run of the chunk from one state, 'parent' is the run it merged into
+struct Parallel_Lane
+{
+    u32 t;
+    u32 parent;
+    u64 last;
+    u64 merged;
+};
+
+struct Parallel_Job
+{
+    const Dfa *dfa;
+    u32 t;
+    string expr;
+    u64 n;
+    u64 chunk;
+    u32 chunks;
+    Chunk_Map *maps;
+};
+
+void map_chunk(const Dfa *dfa, string expr, u64 begin, u64 end, Chunk_Map *map)
+{
+    u32 len = dfa->len;
+    Vec<Parallel_Lane> lanes = new_vec<Parallel_Lane>(len);
+    Vec<u32> alive = new_vec<u32>(len);
+    Vec<u32> merges = new_vec<u32>(len);
+    Vec<u32> owners = new_vec<u32>(len);
+    Vec<u64> stamps = new_vec<u64>(len);
+    stamps.reserve_with(len, npos);
+    owners.len = stamps.len = len;
+    defer(lanes.deinit(); alive.deinit(); merges.deinit(); owners.deinit(); stamps.deinit());
+
+    for (u32 state = 0; state < len; state++) {
+        lanes.push(Parallel_Lane{state << 8, Lane_Root, npos, 0});
+        if (state != Dfa_Dead)
+            alive.push(state);
+    }
+
+    // the runs step together, a run reaching a state taken by another one is merged into it
+    u64 n = begin;
+    for (; n < end and alive.len > 1; n++) {
+        u8 c = expr.data[n];
+        u32 kept = 0;
+
+        for (u32 i = 0; i < alive.len; i++) {
+            Parallel_Lane &lane = lanes[alive[i]];
+            lane.t = dfa->table.data[(lane.t & ~0xffu) | c];
+
+            u32 state = lane.t >> 8;
+            if (state == Dfa_Dead)
+                continue;
+            if (lane.t & Dfa_Accept)
+                lane.last = n + 1;
+
+            if (stamps[state] == n) {
+                lane.parent = owners[state];
+                lane.merged = n + 1;
+                merges.push(alive[i]);
+                continue;
+            }
+            stamps[state] = n;
+            owners[state] = alive[i];
+            alive[kept++] = alive[i];
+        }
+        alive.len = kept;
+    }
+
+    // one run is left, it goes on as Dfa::run
+    if (alive.len == 1) {
+        Parallel_Lane &lane = lanes[alive[0]];
+        for (; n < end; n++) {
+            lane.t = dfa->table.data[(lane.t & ~0xffu) | (u8)expr.data[n]];
+            if (lane.t >> 8 == Dfa_Dead)
+                break;
+            if (lane.t & Dfa_Accept)
+                lane.last = n + 1;
+        }
+    }
+
+    // a merged run ends as the run it joined, and shares its matches after the merge
+    for (u32 i = merges.len; i-- > 0;) {
+        Parallel_Lane &lane = lanes[merges[i]];
+        const Parallel_Lane &parent = lanes[lane.parent];
+        lane.t = parent.t;
+        if (parent.last != npos and parent.last >= lane.merged)
+            lane.last = parent.last;
+    }
+
+    for (u32 state = 0; state < len; state++) {
+        map->ends[state] = lanes[state].t >> 8;
+        map->lasts[state] = lanes[state].last;
+    }
+}
+
+// The first chunk starts in a known state, it is only run from there
+void run_chunk(void *data, u32 index)
+{
+    auto job = (Parallel_Job *)data;
+    u64 begin = job->n + index * job->chunk;
+    u64 end = index + 1 < job->chunks ? begin + job->chunk : job->expr.len;
+
+    if (index != 0)
+        return map_chunk(job->dfa, job->expr, begin, end, &job->maps[index]);
+
+    u32 t = job->t;
+    u64 last = t & Dfa_Accept ? begin : npos;
+    for (u64 n = begin; n < end; n++) {
+        t = job->dfa->table.data[(t & ~0xffu) | (u8)job->expr.data[n]];
+        if (t >> 8 == Dfa_Dead)
+            break;
+        if (t & Dfa_Accept)
+            last = n + 1;
+    }
+    job->maps[0].ends[0] = t >> 8;
+    job->maps[0].lasts[0] = last;
+}
+
+u64 parallel_run(const Dfa *dfa, u32 t, string expr, u64 n, Thread_Pool *pool)
+{
+    u32 chunks = Min((expr.len - n) / Parallel_Chunk_Min, (u64)pool->size());
+    if (chunks < 2)
+        return dfa->run(t, expr, n);
+
+    Vec<Chunk_Map> maps = new_vec<Chunk_Map>(chunks);
+    for (u32 i = 0; i < chunks; i++) {
+        u32 len = i == 0 ? 1 : dfa->len;
+        Chunk_Map map = {new_vec<u32>(len), new_vec<u64>(len)};
+        map.ends.len = map.lasts.len = len;
+        maps.push(map);
+    }
+    defer(for (Chunk_Map &map : maps) { map.ends.deinit(); map.lasts.deinit(); } maps.deinit());
+
+    Parallel_Job job = {dfa, t, expr, n, (expr.len - n) / chunks, chunks, maps.data};
+    pool->run(chunks, run_chunk, &job);
+
+    u32 state = maps[0].ends[0];
+    u64 match = maps[0].lasts[0];
+    for (u32 i = 1; i < chunks and state != Dfa_Dead; i++) {
+        if (maps[i].lasts[state] != npos)
+            match = maps[i].lasts[state];
+        state = maps[i].ends[state];
+    }
+    return match;
+}
+
+Match match_parallel(const Regex *regex, string expr, Thread_Pool *pool)
+{
+    if (!regex->node_head or regex->engine != Engine_Dfa)
+        return regex->match(expr);
+    return new_match(expr, parallel_run(&regex->dfa, regex->dfa.start, expr, 0, pool));
+}
+
+Match find_parallel(const Regex *regex, string haystack, Thread_Pool *pool)
+{
+    if (!regex->node_head or regex->engine != Engine_Dfa)
+        return regex->find(haystack);
+
+    u64 from = 0;
+    u64 end = haystack.len;
+    if (!regex->prefilter.empty() and !regex->prefilter.window(haystack, 0, &from, &end))
+        return new_match(haystack, npos);
+
+    end = parallel_run(&regex->dfa, regex->dfa.unanchored, haystack, from, pool);
+    if (end == npos)
+        return new_match(haystack, npos);
+
+    u64 begin = regex->reverse.submit(&regex->prog, haystack, from, end, &thread_scratch(regex)->reverse);
+    return new_match(haystack.begin_at(&haystack.data[begin]), end - begin);
+}
+
+} // namespace bee::regex
@@ -0,0 +1,33 @@
+#ifndef BEE_REGEX_PARALLEL_HPP
+#define BEE_REGEX_PARALLEL_HPP
+
+#include "regex.hpp"
+#include "thread_pool.hpp"
+
+namespace bee::regex
+{
+
+// Dfa matching of one large input split in chunks run side by side. The
+// state a chunk starts in is only known once the chunks before it are run,
+// so every chunk is run from every state at once. Runs reaching the same
+// state follow the same path from there and are merged, most of them are
+// merged within a few bytes. The map of every chunk, from the state it
+// starts in to the state it ends in and its last match, is then composed
+// in order into the result of one sequential run.
+const u64 Parallel_Chunk_Min = 64 << 10;
+
+struct Chunk_Map
+{
+    Vec<u32> ends;
+    Vec<u64> lasts; // end of the last match in the chunk, npos without one
+};
+
+// Same result as Dfa::run, inputs shorter than two chunks are run on the caller
+u64 parallel_run(const Dfa *dfa, u32 t, string expr, u64 n, Thread_Pool *pool);
+// Regex::match and Regex::find, regexes without Engine_Dfa run on the caller
+Match match_parallel(const Regex *regex, string expr, Thread_Pool *pool);
+Match find_parallel(const Regex *regex, string haystack, Thread_Pool *pool);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,183 @@
+#include "regex_pike.hpp"
+
+namespace bee::regex
+{
+
+void Pike_Vm::deinit()
+{
+    if (!scratch)
+        return;
+    for (size_t i = 0; i < scratch->levels.len; i++) {
+        Pike_Level *level = scratch->levels[i];
+        level->clist.deinit();
+        level->nlist.deinit();
+        level->stack.deinit();
+        delete level;
+    }
+    scratch->levels.deinit();
+    scratch->cstarts.deinit();
+    scratch->nstarts.deinit();
+    delete scratch;
+}
+
+u64 Pike_Vm::submit(string expr) const
+{
+    return run(prog.start, expr, 0, 0, false);
+}
+
+// Returns the end of the leftmost match starting at or after 'from' and sets
+// 'begin' to its start. A new thread is started at every position with the
+// lowest priority, until a match is found.
+u64 Pike_Vm::search(string expr, u64 from, u64 *begin) const
+{
+    Pike_Level *threads = level(0);
+    Sparse_Set *clist = &threads->clist;
+    Sparse_Set *nlist = &threads->nlist;
+    u64 *cstarts = scratch->cstarts.data;
+    u64 *nstarts = scratch->nstarts.data;
+    u64 match = npos;
+
+    clist->clear();
+    for (u64 n = from;; n++) {
+        if (match == npos) {
+            u32 len = clist->len;
+            bool accept = closure(prog.start, expr, n, 0, clist);
+            for (u32 i = len; i < clist->len; i++)
+                cstarts[clist->dense[i]] = n;
+            if (accept)
+                match = n, *begin = n;
+        }
+        if (n >= expr.len or (clist->empty() and match != npos))
+            break;
+
+        nlist->clear();
+        for (u32 pc : *clist) {
+            const Inst &inst = prog.insts[pc];
+            bool step = false;
+
+            if (inst.op == Op_Not)
+                step = run(inst.y, expr, n, 1, true) == npos;
+            else
+                step = inst.step(expr[n]);
+            if (!step)
+                continue;
+
+            u32 len = nlist->len;
+            bool accept = closure(inst.x, expr, n + 1, 0, nlist);
+            for (u32 i = len; i < nlist->len; i++)
+                nstarts[nlist->dense[i]] = cstarts[pc];
+            if (accept) {
+                match = n + 1, *begin = cstarts[pc];
+                break;
+            }
+        }
+
+        Sparse_Set *list = clist;
+        clist = nlist;
+        nlist = list;
+        u64 *starts = cstarts;
+        cstarts = nstarts;
+        nstarts = starts;
+    }
+    return match;
+}
+
+// Returns the end of the highest priority match starting at 'n', with 'any'
+// the first match found is returned (lookaround only need to know that one exists)
+u64 Pike_Vm::run(u32 pc, string expr, u64 n, u32 depth, bool any) const
+{
+    Pike_Level *threads = level(depth);
+    Sparse_Set *clist = &threads->clist;
+    Sparse_Set *nlist = &threads->nlist;
+    u64 match = npos;
+
+    clist->clear();
+    if (closure(pc, expr, n, depth, clist)) {
+        match = n;
+        if (any)
+            return match;
+    }
+
+    for (; n < expr.len and !clist->empty(); n++) {
+        nlist->clear();
+
+        for (u32 pc : *clist) {
+            const Inst &inst = prog.insts[pc];
+            bool step = false;
+
+            if (inst.op == Op_Not)
+                step = run(inst.y, expr, n, depth + 1, true) == npos;
+            else
+                step = inst.step(expr[n]);
+
+            // lower priority threads are cut by the match
+            if (step and closure(inst.x, expr, n + 1, depth, nlist)) {
+                match = n + 1;
+                if (any)
+                    return match;
+                break;
+            }
+        }
+
+        Sparse_Set *list = clist;
+        clist = nlist;
+        nlist = list;
+    }
+    return match;
+}
+
+// Adds the threads reached from 'pc' in priority order, returns true on Op_Match
+bool Pike_Vm::closure(u32 pc, string expr, u64 n, u32 depth, Sparse_Set *list) const
+{
+    Vec<u32> *stack = &level(depth)->stack;
+    stack->len = 0;
+    stack->push(pc);
+
+    while (!stack->empty()) {
+        pc = stack->pop();
+        if (!list->insert(pc))
+            continue;
+
+        const Inst &inst = prog.insts[pc];
+        switch (inst.op) {
+        case Op_Match:
+            return true;
+        case Op_Jump:
+            stack->push(inst.x);
+            break;
+        case Op_Split:
+            stack->push(inst.y);
+            stack->push(inst.x);
+            break;
+        case Op_Dash:
+            if (n < expr.len and run(inst.y, expr, n, depth + 1, true) != npos)
+                stack->push(inst.x);
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+Pike_Level *Pike_Vm::level(u32 depth) const
+{
+    Vec<Pike_Level *> *levels = &scratch->levels;
+
+    while (levels->len <= depth) {
+        u32 len = prog.insts.len;
+        levels->push(new Pike_Level{new_sparse_set(len), new_sparse_set(len), new_vec<u32>(16)});
+    }
+    return (*levels)[depth];
+}
+
+Pike_Vm new_pike_vm(const Prog *prog)
+{
+    Pike_Vm vm = {*prog, new Pike_Scratch{}};
+    vm.level(0);
+    vm.scratch->cstarts = new_vec<u64>(prog->insts.len);
+    vm.scratch->nstarts = new_vec<u64>(prog->insts.len);
+    return vm;
+}
+
+} // namespace bee::regex
@@ -0,0 +1,45 @@
+#ifndef BEE_REGEX_PIKE_HPP
+#define BEE_REGEX_PIKE_HPP
+
+#include "regex_prog.hpp"
+
+namespace bee::regex
+{
+
+// Thompson simulation of the program, every thread advances in lockstep and
+// a program counter is visited at most once per input position, so matching
+// is O(len * insts). Lookarounds run as anchored sub-simulations one level
+// deeper, each level owns its thread lists.
+struct Pike_Level
+{
+    Sparse_Set clist;
+    Sparse_Set nlist;
+    Vec<u32> stack;
+};
+
+// Start of the match every thread belongs to, only searches need them
+struct Pike_Scratch
+{
+    Vec<Pike_Level *> levels;
+    Vec<u64> cstarts;
+    Vec<u64> nstarts;
+};
+
+struct Pike_Vm
+{
+    Prog prog;
+    Pike_Scratch *scratch;
+
+    void deinit();
+    u64 submit(string expr) const;
+    u64 search(string expr, u64 from, u64 *begin) const;
+    u64 run(u32 pc, string expr, u64 n, u32 depth, bool any) const;
+    bool closure(u32 pc, string expr, u64 n, u32 depth, Sparse_Set *list) const;
+    Pike_Level *level(u32 depth) const;
+};
+
+Pike_Vm new_pike_vm(const Prog *prog);
+
+} // namespace bee::regex
+
+#endif
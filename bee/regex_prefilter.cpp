@@ -0,0 +1,366 @@
+#include "regex_prefilter.hpp"
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+bool Prefilter::empty() const
+{
+    return literal.len == 0;
+}
+
+// Finds the range of match starts that can reach the next occurrence of the
+// literal after 'from', returns false when the literal does not occur anymore
+bool Prefilter::window(string haystack, u64 from, u64 *begin, u64 *end) const
+{
+    if (from + min + literal.len > haystack.len)
+        return false;
+
+    string rest = {&haystack.data[from + min], haystack.end()};
+    const char *occurence = rest.find(literal);
+    if (occurence == rest.end())
+        return false;
+
+    u64 at = occurence - haystack.begin();
+    *begin = max != Prefilter_Unbounded and at - from > max ? at - max : from;
+    *end = at - min;
+    return true;
+}
+
+bool node_passes(Node *node)
+{
+    return node->state.option != Regex_None and node->state.option != Regex_Monostate;
+}
+
+u64 node_width(Node *node)
+{
+    switch (node->state.option) {
+    case Regex_Str:
+        return node->state.str.len;
+    case Regex_Eps:
+    case Regex_Dash:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+// One path from the head to a leaf, empty when no match can end
+void find_path(Node_Arena *arena, Node *head, Vec<u32> *parent, Vec<u8> *visited, Vec<Node *> *stack,
+               Vec<Node *> *path)
+{
+    if (!node_passes(head))
+        return;
+
+    (*visited)[head->id] = true;
+    stack->push(head);
+
+    Node *leaf = NULL;
+    while (!stack->empty() and !leaf) {
+        Node *node = stack->pop();
+        if (node->leaf) {
+            leaf = node;
+            continue;
+        }
+        for (Node *edge : node->out) {
+            if ((*visited)[edge->id] or !node_passes(edge))
+                continue;
+            (*visited)[edge->id] = true;
+            (*parent)[edge->id] = node->id;
+            stack->push(edge);
+        }
+    }
+
+    for (Node *node = leaf; node != NULL; node = node != head ? &(*arena)[(*parent)[node->id]] : NULL)
+        path->push(node);
+    for (size_t i = 0; i < path->len / 2; i++) {
+        Node *node = (*path)[i];
+        (*path)[i] = (*path)[path->len - 1 - i];
+        (*path)[path->len - 1 - i] = node;
+    }
+}
+
+// The nodes every match passes through are the nodes of one path that no
+// detour goes around: the path is walked in order, the search from each of
+// its nodes stops on the path and 'reach' is the furthest index a detour
+// lands on (the path length for a leaf), every node is searched once
+void find_required(Node_Arena *arena, Node *head, Vec<u8> *required)
+{
+    Vec<u32> parent = new_vec<u32>(arena->len);
+    Vec<u32> index = new_vec<u32>(arena->len);
+    Vec<u8> visited = new_vec<u8>(arena->len);
+    Vec<Node *> stack = new_vec<Node *>(16);
+    Vec<Node *> path = new_vec<Node *>(16);
+    parent.len = index.len = visited.len = arena->len;
+    defer(parent.deinit());
+    defer(index.deinit());
+    defer(visited.deinit());
+    defer(stack.deinit());
+    defer(path.deinit());
+
+    memset(visited.data, 0, visited.len);
+    find_path(arena, head, &parent, &visited, &stack, &path);
+
+    memset(visited.data, 0, visited.len);
+    memset(index.data, 0xff, index.len * sizeof(u32));
+    for (size_t i = 0; i < path.len; i++)
+        index[path[i]->id] = i;
+
+    u32 reach = 0;
+    for (u32 i = 0; i < path.len; i++) {
+        (*required)[path[i]->id] = reach <= i;
+
+        stack.len = 0;
+        stack.push(path[i]);
+        while (!stack.empty()) {
+            Node *node = stack.pop();
+            if (node->leaf) {
+                reach = path.len;
+                continue;
+            }
+            for (Node *edge : node->out) {
+                if (index[edge->id] != (u32)npos)
+                    reach = Max(reach, index[edge->id]);
+                else if (!visited[edge->id] and node_passes(edge))
+                    visited[edge->id] = true, stack.push(edge);
+            }
+        }
+    }
+}
+
+// Shortest distance from the match start to every node (npos when it is not
+// reached), the distances are bounded by the widths of all the nodes so
+// the queue is one bucket per distance
+void make_min_distances(Node_Arena *arena, Node *head, Vec<u64> *min)
+{
+    u64 bound = 0;
+    for (size_t i = 0; i < arena->len; i++)
+        bound += node_width(&(*arena)[i]);
+
+    Vec<u32> buckets = new_vec<u32>(bound + 1);
+    Vec<u32> queued = new_vec<u32>(arena->len);
+    Vec<u32> next = new_vec<u32>(arena->len);
+    buckets.len = bound + 1;
+    defer(buckets.deinit());
+    defer(queued.deinit());
+    defer(next.deinit());
+
+    memset(buckets.data, 0xff, buckets.len * sizeof(u32));
+    for (size_t i = 0; i < arena->len; i++)
+        (*min)[i] = npos;
+    (*min)[head->id] = 0;
+    queued.push(head->id), next.push(buckets[0]), buckets[0] = 0;
+
+    for (u64 distance = 0; distance <= bound; distance++) {
+        while (buckets[distance] != (u32)npos) {
+            u32 at = buckets[distance];
+            Node *node = &(*arena)[queued[at]];
+            buckets[distance] = next[at];
+            if ((*min)[node->id] != distance or !node_passes(node))
+                continue;
+
+            for (Node *edge : node->out) {
+                u64 lo = distance + node_width(node);
+                if (lo >= (*min)[edge->id])
+                    continue;
+                (*min)[edge->id] = lo;
+                queued.push(edge->id), next.push(buckets[lo]), buckets[lo] = queued.len - 1;
+            }
+        }
+    }
+}
+
+// Tarjan's strongly connected components of the nodes reached from the head,
+// 'members' lists them one component after the other from the last in
+// topological order to the first, 'begins' gives where each one starts
+void make_components(Node_Arena *arena, Node *head, Vec<u32> *members, Vec<u32> *begins)
+{
+    struct Frame
+    {
+        u32 node;
+        u32 edge;
+    };
+
+    Vec<u32> order = new_vec<u32>(arena->len);
+    Vec<u32> low = new_vec<u32>(arena->len);
+    Vec<u8> stacked = new_vec<u8>(arena->len);
+    Vec<u32> stack = new_vec<u32>(16);
+    Vec<Frame> frames = new_vec<Frame>(16);
+    order.len = low.len = stacked.len = arena->len;
+    defer(order.deinit());
+    defer(low.deinit());
+    defer(stacked.deinit());
+    defer(stack.deinit());
+    defer(frames.deinit());
+
+    memset(order.data, 0, order.len * sizeof(u32));
+    memset(stacked.data, 0, stacked.len);
+
+    u32 count = 0;
+    order[head->id] = low[head->id] = ++count;
+    stacked[head->id] = true;
+    stack.push(head->id);
+    frames.push(Frame{head->id, 0});
+
+    while (!frames.empty()) {
+        u32 id = frames[frames.len - 1].node;
+        Node *node = &(*arena)[id];
+        u32 edge = frames[frames.len - 1].edge++;
+
+        if (node_passes(node) and edge < node->out.len) {
+            u32 next = node->out[edge]->id;
+            if (!order[next]) {
+                order[next] = low[next] = ++count;
+                stacked[next] = true;
+                stack.push(next);
+                frames.push(Frame{next, 0});
+            } else if (stacked[next]) {
+                low[id] = Min(low[id], order[next]);
+            }
+            continue;
+        }
+
+        frames.pop();
+        if (!frames.empty()) {
+            u32 caller = frames[frames.len - 1].node;
+            low[caller] = Min(low[caller], low[id]);
+        }
+        if (low[id] != order[id])
+            continue;
+
+        begins->push(members->len);
+        u32 member;
+        do {
+            member = stack.pop();
+            stacked[member] = false;
+            members->push(member);
+        } while (member != id);
+    }
+}
+
+// Max distance from the match start to every node, every node of a component
+// is as far as its furthest one when the component has no byte to loop over,
+// else the distance grows with every loop and is unbounded after it
+void make_max_distances(Node_Arena *arena, Node *head, Vec<u64> *min, Vec<u64> *max)
+{
+    Vec<u32> members = new_vec<u32>(arena->len);
+    Vec<u32> begins = new_vec<u32>(16);
+    Vec<u32> component = new_vec<u32>(arena->len);
+    component.len = arena->len;
+    defer(members.deinit());
+    defer(begins.deinit());
+    defer(component.deinit());
+
+    make_components(arena, head, &members, &begins);
+    for (size_t c = 0; c < begins.len; c++) {
+        size_t end = c + 1 < begins.len ? begins[c + 1] : members.len;
+        for (size_t i = begins[c]; i < end; i++)
+            component[members[i]] = c;
+    }
+    for (size_t i = 0; i < arena->len; i++)
+        (*max)[i] = 0;
+
+    for (size_t c = begins.len; c-- > 0;) {
+        size_t begin = begins[c];
+        size_t end = c + 1 < begins.len ? begins[c + 1] : members.len;
+        u64 furthest = 0;
+        bool loops = end - begin > 1;
+        bool consumes = false;
+
+        for (size_t i = begin; i < end; i++) {
+            Node *node = &(*arena)[members[i]];
+            u64 distance = (*max)[node->id];
+            furthest = distance == Prefilter_Unbounded ? Prefilter_Unbounded : Max(furthest, distance);
+            consumes |= node_width(node) > 0;
+            for (Node *edge : node->out)
+                loops |= edge == node and node_passes(node);
+            if (furthest == Prefilter_Unbounded)
+                break;
+        }
+        if (loops and consumes)
+            furthest = Prefilter_Unbounded;
+
+        for (size_t i = begin; i < end; i++) {
+            Node *node = &(*arena)[members[i]];
+            (*max)[node->id] = furthest;
+            if (!node_passes(node))
+                continue;
+
+            u64 hi = furthest != Prefilter_Unbounded ? furthest + node_width(node) : Prefilter_Unbounded;
+            for (Node *edge : node->out) {
+                u64 &edge_max = (*max)[edge->id];
+                if (component[edge->id] != c and edge_max != Prefilter_Unbounded)
+                    edge_max = hi == Prefilter_Unbounded ? hi : Max(edge_max, hi);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < arena->len; i++) {
+        if ((*min)[i] == npos)
+            (*max)[i] = npos;
+    }
+}
+
+bool prefilter_is_better(Prefilter a, Prefilter b)
+{
+    bool a_bounded = a.max != Prefilter_Unbounded;
+    bool b_bounded = b.max != Prefilter_Unbounded;
+    if (a_bounded != b_bounded)
+        return a_bounded;
+    if (a_bounded and (a.max - a.min) != (b.max - b.min))
+        return (a.max - a.min) < (b.max - b.min);
+    return a.literal.len > b.literal.len;
+}
+
+bool is_literal(Node *node)
+{
+    return node->state.option == Regex_Str and node->state.str.len > 0;
+}
+
+// The distances are only made when a literal is required, most patterns
+// are done after one pass over their nodes
+Prefilter compile_prefilter(Node_Arena *arena, Node *head)
+{
+    Prefilter prefilter = {};
+    if (!head or arena->len == 0)
+        return prefilter;
+
+    bool literals = false;
+    for (size_t i = 0; i < arena->len and !literals; i++)
+        literals = is_literal(&(*arena)[i]);
+    if (!literals)
+        return prefilter;
+
+    Vec<u8> required = new_vec<u8>(arena->len);
+    Vec<u64> min = new_vec<u64>(arena->len);
+    Vec<u64> max = new_vec<u64>(arena->len);
+    required.len = min.len = max.len = arena->len;
+    defer(required.deinit());
+    defer(min.deinit());
+    defer(max.deinit());
+
+    memset(required.data, 0, required.len);
+    find_required(arena, head, &required);
+
+    literals = false;
+    for (size_t i = 0; i < arena->len and !literals; i++)
+        literals = required[i] and is_literal(&(*arena)[i]);
+    if (!literals)
+        return prefilter;
+
+    make_min_distances(arena, head, &min);
+    make_max_distances(arena, head, &min, &max);
+
+    for (size_t i = 0; i < arena->len; i++) {
+        Node *node = &(*arena)[i];
+        if (!is_literal(node) or !required[i] or min[i] == npos)
+            continue;
+
+        Prefilter candidate = {node->state.str, min[i], max[i]};
+        if (prefilter.empty() or prefilter_is_better(candidate, prefilter))
+            prefilter = candidate;
+    }
+    return prefilter;
+}
+
+} // namespace bee::regex
@@ -0,0 +1,29 @@
+#ifndef BEE_REGEX_PREFILTER_HPP
+#define BEE_REGEX_PREFILTER_HPP
+
+#include "ds.hpp"
+
+namespace bee::regex
+{
+struct Node;
+typedef Block_Arena<struct Node> Node_Arena;
+
+// Literal that every match contains between 'min' and 'max' bytes after its
+// start, unanchored search only runs the engine around its occurrences
+struct Prefilter
+{
+    string literal;
+    u64 min;
+    u64 max;
+
+    bool empty() const;
+    bool window(string haystack, u64 from, u64 *begin, u64 *end) const;
+};
+
+const u64 Prefilter_Unbounded = npos;
+
+Prefilter compile_prefilter(Node_Arena *arena, Node *head);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,385 @@
+#include "regex_prog.hpp"
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+bool Inst::consumes() const
+{
+    switch (op) {
+    case Op_Any:
+    case Op_Range:
+    case Op_Set:
+    case Op_Not:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Inst::step(u8 c) const
+{
+    switch (op) {
+    case Op_Any:
+        return true;
+    case Op_Range:
+        return (u8)range[0] <= c and c <= (u8)range[1];
+    case Op_Set:
+        return set.has(c);
+    default:
+        return false;
+    }
+}
+
+void Prog::deinit()
+{
+    insts.deinit();
+}
+
+// Adds the threads reached from 'pc' in priority order, returns the accept of
+// the first rule that reaches Op_Match
+u32 Prog::closure(u32 pc, Sparse_Set *set, Vec<u32> *stack) const
+{
+    u32 accept = 0;
+    u32 cut = 0;
+    stack->len = 0;
+    stack->push(pc);
+
+    while (!stack->empty()) {
+        pc = stack->pop();
+        const Inst &inst = insts[pc];
+
+        // the rules are explored one after another, the rest of a rule
+        // that matched is cut
+        if (cut and inst.rule == cut - 1)
+            continue;
+        if (!set->insert(pc))
+            continue;
+
+        switch (inst.op) {
+        case Op_Match:
+            if (rules == 0)
+                return 1;
+            cut = inst.rule + 1;
+            accept = accept ? accept : cut;
+            break;
+        case Op_Jump:
+            stack->push(inst.x);
+            break;
+        case Op_Split:
+            // 1st alternative is popped first, it has the priority
+            stack->push(inst.y);
+            stack->push(inst.x);
+            break;
+        default:
+            break;
+        }
+    }
+    return accept;
+}
+
+u32 node_body_len(const Node *node)
+{
+    switch (node->state.option) {
+    case Regex_Eps:
+        return 0;
+    case Regex_Str:
+        return node->state.str.len;
+    default:
+        return 1;
+    }
+}
+
+u32 node_exit_len(const Node *node)
+{
+    u32 alts = node->out.len + node->leaf;
+    return alts > 1 ? alts - 1 : 1;
+}
+
+// Node layout (the graph must be frozen):
+//   [body: one instruction per consumed byte] [exit: alternatives]
+// exit: > edge[0] ... > edge[n], > match when the node has no forward edges
+void emit_node(Prog *prog, Vec<u32> *entries, const Node *node)
+{
+    State state = node->state;
+    u32 pc = prog->insts.len;
+    u32 exit = pc + node_body_len(node);
+
+    switch (state.option) {
+    case Regex_Eps:
+        break;
+    case Regex_Monostate:
+    case Regex_None:
+        prog->insts.push(Inst{Op_Fail, 0, 0, {}, {}, 0});
+        break;
+    case Regex_Any:
+        prog->insts.push(Inst{Op_Any, exit, 0, {}, {}, 0});
+        break;
+    case Regex_Not:
+    case Regex_Dash: {
+        Opcode op = state.option == Regex_Not ? Op_Not : Op_Dash;
+        prog->insts.push(Inst{op, exit, (*entries)[state.sequence->id], {}, {}, 0});
+        break;
+    }
+    case Regex_Str:
+        for (size_t i = 0; i < state.str.len; i++) {
+            u32 next = prog->insts.len + 1;
+            prog->insts.push(Inst{Op_Range, next, 0, {state.str[i], state.str[i]}, {}, 0});
+        }
+        break;
+    case Regex_Set:
+    case Regex_Scope:
+        prog->insts.push(Inst{Op_Set, exit, 0, {}, state.set, 0});
+        break;
+    }
+
+    Vec<u32> alts = new_vec<u32>(4);
+    defer(alts.deinit());
+    for (Node *edge : node->out)
+        alts.push((*entries)[edge->id]);
+    if (node->leaf)
+        alts.push(Prog_Match);
+    if (alts.len == 0)
+        alts.push(Prog_Fail);
+
+    if (alts.len == 1) {
+        prog->insts.push(Inst{Op_Jump, alts[0], 0, {}, {}, 0});
+        return;
+    }
+    for (size_t i = 0; i + 1 < alts.len; i++) {
+        u32 next = i + 2 < alts.len ? prog->insts.len + 1 : alts[i + 1];
+        prog->insts.push(Inst{Op_Split, alts[i], next, {}, {}, 0});
+    }
+}
+
+// Splits the byte classes by the members of every consuming instruction, a
+// byte that was split out alone is not split again
+Byte_Classes make_byte_classes(const Vec<Inst> *insts)
+{
+    Byte_Classes classes = {{}, 1};
+    Byte_Set singles = {};
+    u16 split[256][2];
+
+    for (const Inst &inst : *insts) {
+        if (inst.op != Op_Range and inst.op != Op_Set)
+            continue;
+        if (inst.op == Op_Range and inst.range[0] == inst.range[1]) {
+            if (singles.has(inst.range[0]))
+                continue;
+            singles.insert(inst.range[0]);
+        }
+
+        memset(split, 0, sizeof(split));
+        u32 len = 0;
+        for (u32 c = 0; c < 256; c++) {
+            u16 &id = split[classes[c]][inst.step(c)];
+            if (!id)
+                id = ++len;
+            classes.classes[c] = id - 1;
+        }
+        classes.len = len;
+    }
+    return classes;
+}
+
+Prog compile_prog(const Node_Arena *arena, const Node *head)
+{
+    Prog prog = {};
+    Vec<u32> entries = new_vec<u32>(arena->len + 1);
+    defer(entries.deinit());
+
+    u32 len = 2;
+    for (size_t i = 0; i < arena->len; i++) {
+        const Node *node = &(*arena)[i];
+        entries.push(len);
+        len += node_body_len(node) + node_exit_len(node);
+        prog.has_lookaround |= node->state.option == Regex_Not or node->state.option == Regex_Dash;
+    }
+
+    prog.insts = new_vec<Inst>(len);
+    prog.insts.push(Inst{Op_Fail, 0, 0, {}, {}, 0});
+    prog.insts.push(Inst{Op_Match, 0, 0, {}, {}, 0});
+    for (size_t i = 0; i < arena->len; i++) {
+        Assert(prog.insts.len == entries[i], "node layout does not match its entry");
+        emit_node(&prog, &entries, &(*arena)[i]);
+    }
+
+    prog.start = head != NULL ? entries[head->id] : Prog_Fail;
+    prog.unanchored = prog.insts.len;
+    prog.insts.push(Inst{Op_Split, prog.start, prog.unanchored + 1, {}, {}, 0});
+    prog.insts.push(Inst{Op_Any, prog.unanchored, 0, {}, {}, 0});
+    prog.classes = make_byte_classes(&prog.insts);
+    return prog;
+}
+
+Prog merge_progs(View<Prog> progs)
+{
+    Prog prog = {};
+    prog.rules = progs.len;
+    prog.insts = new_vec<Inst>(64);
+    prog.insts.push(Inst{Op_Fail, 0, 0, {}, {}, Prog_No_Rule});
+    prog.insts.push(Inst{Op_Match, 0, 0, {}, {}, Prog_No_Rule});
+
+    // start: split > start[0]
+    //              > split > start[1] ...
+    u32 start = prog.insts.len;
+    for (size_t i = 0; i + 1 < progs.len; i++)
+        prog.insts.push(Inst{Op_Split, 0, start + (u32)i + 1, {}, {}, Prog_No_Rule});
+    prog.start = progs.len > 1 ? start : Prog_Fail;
+
+    for (size_t i = 0; i < progs.len; i++) {
+        const Prog &rule = progs[i];
+        u32 base = prog.insts.len;
+        if (progs.len == 1)
+            prog.start = base + rule.start;
+        else if (i + 1 < progs.len)
+            prog.insts[start + i].x = base + rule.start;
+        else
+            prog.insts[start + i - 1].y = base + rule.start;
+
+        // the unanchored loop of every rule is left out
+        for (u32 pc = 0; pc < rule.unanchored; pc++) {
+            Inst inst = rule.insts[pc];
+            inst.rule = i;
+            if (inst.op != Op_Fail and inst.op != Op_Match)
+                inst.x += base;
+            if (inst.op == Op_Split or inst.op == Op_Not or inst.op == Op_Dash)
+                inst.y += base;
+            prog.insts.push(inst);
+        }
+        prog.has_lookaround |= rule.has_lookaround;
+    }
+
+    prog.unanchored = prog.start;
+    prog.classes = make_byte_classes(&prog.insts);
+    return prog;
+}
+
+void Reverse_Prog::deinit()
+{
+    offsets.deinit();
+    preds.deinit();
+    flags.deinit();
+}
+
+void Reverse_Lists::deinit()
+{
+    set.deinit();
+    next.deinit();
+}
+
+// Start of the longest match ending at 'end' that starts at or after 'from',
+// 'end' must be the end of a match
+u64 Reverse_Prog::submit(const Prog *prog, string expr, u64 from, u64 end, Reverse_Lists *lists) const
+{
+    if (lists->set.cap < prog->insts.len) {
+        lists->deinit();
+        lists->set = new_sparse_set(prog->insts.len);
+        lists->next = new_sparse_set(prog->insts.len);
+    }
+    Sparse_Set set = lists->set;
+    Sparse_Set next = lists->next;
+    set.clear();
+
+    u64 begin = empty ? end : npos;
+    for (u32 pc = 0; pc < flags.len; pc++) {
+        if (flags[pc] & Reverse_Last)
+            set.insert(pc);
+    }
+
+    for (u64 n = end; n > from and !set.empty(); n--) {
+        u8 c = expr[n - 1];
+        next.clear();
+
+        for (u32 pc : set) {
+            if (!prog->insts[pc].step(c))
+                continue;
+            if (flags[pc] & Reverse_First)
+                begin = n - 1;
+            for (u32 i = offsets[pc]; i < offsets[pc + 1]; i++)
+                next.insert(preds[i]);
+        }
+
+        Sparse_Set swap = set;
+        set = next;
+        next = swap;
+    }
+    return begin;
+}
+
+Reverse_Prog compile_reverse_prog(const Prog *prog)
+{
+    // the unanchored loop is not part of a match
+    u32 len = prog->unanchored;
+    Reverse_Prog reverse = {};
+    Sparse_Set set = new_sparse_set(prog->insts.len);
+    Vec<u32> stack = new_vec<u32>(16);
+    Vec<u32> edges = new_vec<u32>(len * 2);
+    defer(set.deinit());
+    defer(stack.deinit());
+
+    // every closure is taken in full, priorities do not matter backward
+    auto reach = [&](u32 pc) {
+        set.clear();
+        stack.len = 0;
+        stack.push(pc);
+        while (!stack.empty()) {
+            pc = stack.pop();
+            if (pc >= len or !set.insert(pc))
+                continue;
+            const Inst &inst = prog->insts[pc];
+            if (inst.op == Op_Jump)
+                stack.push(inst.x);
+            if (inst.op == Op_Split)
+                stack.push(inst.y), stack.push(inst.x);
+        }
+    };
+
+    reverse.flags = new_vec<u8>(len);
+    reverse.flags.reserve_with(len, 0);
+    reverse.flags.len = len;
+
+    reach(prog->start);
+    reverse.empty = set.has(Prog_Match);
+    for (u32 pc : set)
+        reverse.flags[pc] |= Reverse_First;
+
+    // edges as (successor, predecessor) pairs then grouped by successor
+    for (u32 pc = 0; pc < len; pc++) {
+        if (!prog->insts[pc].consumes())
+            continue;
+        reach(prog->insts[pc].x);
+        if (set.has(Prog_Match))
+            reverse.flags[pc] |= Reverse_Last;
+        for (u32 next : set) {
+            if (prog->insts[next].consumes())
+                edges.push(next), edges.push(pc);
+        }
+    }
+
+    reverse.offsets = new_vec<u32>(len + 1);
+    reverse.offsets.reserve_with(len + 1, 0);
+    reverse.offsets.len = len + 1;
+    for (size_t i = 0; i < edges.len; i += 2)
+        reverse.offsets[edges[i] + 1]++;
+    for (u32 pc = 0; pc < len; pc++)
+        reverse.offsets[pc + 1] += reverse.offsets[pc];
+
+    Vec<u32> fill = new_vec<u32>(len + 1);
+    fill.concat(reverse.offsets.begin(), reverse.offsets.end());
+    defer(fill.deinit());
+
+    reverse.preds = new_vec<u32>(edges.len / 2 + 1);
+    reverse.preds.len = edges.len / 2;
+    for (size_t i = 0; i < edges.len; i += 2)
+        reverse.preds[fill[edges[i]]++] = edges[i + 1];
+
+    edges.deinit();
+    for (u32 pc = 0; pc < len; pc++) {
+        if (!prog->insts[pc].consumes())
+            reverse.flags[pc] &= ~Reverse_First;
+    }
+    return reverse;
+}
+
+} // namespace bee::regex
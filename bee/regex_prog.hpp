@@ -0,0 +1,116 @@
+#ifndef BEE_REGEX_PROG_HPP
+#define BEE_REGEX_PROG_HPP
+
+#include "ds.hpp"
+
+namespace bee::regex
+{
+struct Node;
+typedef Block_Arena<struct Node> Node_Arena;
+
+// Byte level program lowered from the node graph, every consuming
+// instruction matches exactly one byte. Alternatives are kept in the
+// order the backtracker tries them, so its first match is the highest
+// priority match of the program.
+enum Opcode
+{
+    Op_Fail,
+    Op_Match,
+    Op_Jump,
+    Op_Split,
+    Op_Any,
+    Op_Range,
+    Op_Set,
+    Op_Not,
+    Op_Dash,
+};
+
+struct Inst
+{
+    Opcode op;
+    u32 x; // next instruction, 1st alternative of Op_Split
+    u32 y; // 2nd alternative of Op_Split, sub-program of Op_Not and Op_Dash
+    char range[2];
+    Byte_Set set;
+    u32 rule; // rule of a merged program
+
+    bool consumes() const;
+    bool step(u8 c) const;
+};
+
+const u32 Prog_Fail = 0;
+const u32 Prog_Match = 1;
+const u32 Prog_No_Rule = (u32)-1;
+
+// Bytes of a class are not told apart by any instruction, automata only
+// need one transition per class
+struct Byte_Classes
+{
+    u8 classes[256];
+    u32 len;
+
+    u8 operator[](u8 c) const
+    {
+        return classes[c];
+    }
+};
+
+// 'unanchored' starts a match at every position, the loop has the lowest
+// priority so the leftmost match wins:
+//   unanchored: split > start
+//                     > ^ > unanchored
+//
+// A merged program runs several rules side by side, a match only cuts the
+// threads of its own rule. Accepts are reported as the first matching rule + 1.
+struct Prog
+{
+    Vec<Inst> insts;
+    u32 start;
+    u32 unanchored;
+    u32 rules;
+    bool has_lookaround;
+    Byte_Classes classes;
+
+    void deinit();
+    u32 closure(u32 pc, Sparse_Set *set, Vec<u32> *stack) const;
+};
+
+Prog compile_prog(const Node_Arena *arena, const Node *head);
+// The rules are tried in order from one start, 'progs' are left untouched
+Prog merge_progs(View<Prog> progs);
+
+// The program read backward, the predecessors of a consuming instruction are
+// the consuming instructions whose closure reaches it. Running it from the end
+// of a match finds the leftmost start of a match ending there.
+enum Reverse_Flag
+{
+    Reverse_First = 1 << 0, // reached by the closure of the start
+    Reverse_Last = 1 << 1,  // its closure reaches Op_Match
+};
+
+// The thread lists of a backward run, made for the program on first use and
+// kept by the caller from one match to the next
+struct Reverse_Lists
+{
+    Sparse_Set set;
+    Sparse_Set next;
+
+    void deinit();
+};
+
+struct Reverse_Prog
+{
+    Vec<u32> offsets;
+    Vec<u32> preds;
+    Vec<u8> flags;
+    bool empty;
+
+    void deinit();
+    u64 submit(const Prog *prog, string expr, u64 from, u64 end, Reverse_Lists *lists) const;
+};
+
+Reverse_Prog compile_reverse_prog(const Prog *prog);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,394 @@
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+// Nodes and edges the passes can fold away:
+// $: epsilon
+// x: none
+// >: edge
+//
+//   o > $ > p      becomes  o > p
+//   o > $ > p, q   becomes  o > p, q when o is the only way into $
+//   o > ..., $'    becomes  o' > ... when $' is a leaf, o is one now
+//   o > [a], [b]   becomes  o > [ab] when both lead to the same nodes
+//   'ab' > 'cd'    becomes  'abcd'
+//   o > x          becomes  o
+Simplifier new_simplifier(Node_Arena *arena, Node **head)
+{
+    Simplifier simplifier = {arena, head, new_vec<u32>(arena->len), new_vec<u8>(arena->len), new_vec<Node *>(16)};
+    simplifier.refs.reserve_with(arena->len, 0);
+    simplifier.fixed.reserve_with(arena->len, false);
+    simplifier.refs.len = simplifier.fixed.len = arena->len;
+
+    for (size_t i = 0; i < arena->len; i++)
+        (*arena)[i].id = i;
+
+    // only the edges of the nodes reached from the head count
+    Vec<Node *> &stack = simplifier.stack;
+    auto reach = [&](Node *node) {
+        if (simplifier.refs[node->id]++ == 0)
+            stack.push(node);
+    };
+    if (*head != NULL)
+        reach(*head);
+
+    while (!stack.empty()) {
+        Node *node = stack.pop();
+        for (Node_Set *it = node->edges; it != NULL; it = it->next)
+            reach(it->node);
+        if (node->state.option == Regex_Not or node->state.option == Regex_Dash)
+            reach(node->state.sequence);
+        if (node->until) {
+            simplifier.fixed[node->edges->node->id] = true;
+            simplifier.fixed[node->edges->next->node->id] = true;
+        }
+    }
+    return simplifier;
+}
+
+void Simplifier::deinit()
+{
+    refs.deinit();
+    fixed.deinit();
+    stack.deinit();
+}
+
+// One reference to 'node' is gone, a node left without any gives up its own
+void Simplifier::unref(Node *node)
+{
+    stack.len = 0;
+    stack.push(node);
+
+    while (!stack.empty()) {
+        node = stack.pop();
+        if (--refs[node->id] != 0)
+            continue;
+
+        for (Node_Set *it = node->edges; it != NULL; it = it->next)
+            stack.push(it->node);
+        if (node->state.option == Regex_Not or node->state.option == Regex_Dash)
+            stack.push(node->state.sequence);
+        node->edges = node->last_edge = NULL;
+    }
+}
+
+// A node that never matches, trying it is the same as skipping it
+bool is_dead(const Node *node)
+{
+    return node->state.option == Regex_None or (!node->leaf and node->edges == NULL);
+}
+
+// A node is swept once one of its edges leads to a node that died, it dies
+// in turn when no edge is left. 'preds' are the nodes whose edges lead to
+// each node, from offsets[id] to offsets[id + 1].
+void Simplifier::drop_dead()
+{
+    size_t len = arena->len;
+    Vec<u32> offsets = new_vec<u32>(len + 1);
+    Vec<u8> queued = new_vec<u8>(len);
+    Vec<Node *> queue = new_vec<Node *>(16);
+    defer(offsets.deinit(); queued.deinit(); queue.deinit());
+    offsets.reserve_with(len + 1, 0);
+    queued.reserve_with(len, false);
+    offsets.len = len + 1, queued.len = len;
+
+    auto swept = [&](const Node *node) { return refs[node->id] and !node->until; };
+    for (size_t i = 0; i < len; i++) {
+        for (Node_Set *it = (*arena)[i].edges; swept(&(*arena)[i]) and it != NULL; it = it->next)
+            offsets[it->node->id]++;
+    }
+    for (size_t i = 1; i <= len; i++)
+        offsets[i] += offsets[i - 1];
+
+    Vec<Node *> preds = new_vec<Node *>(offsets[len] + 1);
+    defer(preds.deinit());
+    preds.len = offsets[len];
+    for (size_t i = 0; i < len; i++) {
+        for (Node_Set *it = (*arena)[i].edges; swept(&(*arena)[i]) and it != NULL; it = it->next)
+            preds[--offsets[it->node->id]] = &(*arena)[i];
+    }
+
+    auto died = [&](const Node *node) {
+        for (u32 k = offsets[node->id]; k < offsets[node->id + 1]; k++) {
+            if (!queued[preds[k]->id])
+                queued[preds[k]->id] = true, queue.push(preds[k]);
+        }
+    };
+    for (size_t i = 0; i < len; i++) {
+        if (refs[i] and is_dead(&(*arena)[i]))
+            died(&(*arena)[i]);
+    }
+
+    for (size_t k = 0; k < queue.len; k++) {
+        Node *node = queue[k];
+        queued[node->id] = false;
+        if (!refs[node->id])
+            continue;
+
+        bool dead = is_dead(node);
+        Node_Set *last = NULL;
+        for (Node_Set **cell = &node->edges; *cell != NULL;) {
+            Node *edge = (*cell)->node;
+            if (!is_dead(edge)) {
+                last = *cell;
+                cell = &(*cell)->next;
+                continue;
+            }
+            *cell = (*cell)->next;
+            unref(edge);
+        }
+        node->last_edge = node->edges != NULL ? last : NULL;
+        if (!dead and is_dead(node))
+            died(node);
+    }
+}
+
+// An epsilon that only passes to one node
+bool is_forward(const Node *node)
+{
+    return node->state.option == Regex_Eps and !node->leaf and !node->until and node->edges != NULL and
+           node->edges->next == NULL;
+}
+
+// Forwards that lead back to themselves are kept, the loop is in the pattern
+void Simplifier::mark_cycles(Vec<u8> *cyclic)
+{
+    enum
+    {
+        Unseen,
+        Walked,
+        Done
+    };
+    Vec<u8> marks = new_vec<u8>(arena->len);
+    defer(marks.deinit());
+    marks.reserve_with(arena->len, Unseen);
+    marks.len = arena->len;
+    cyclic->reserve_with(arena->len, false);
+    cyclic->len = arena->len;
+
+    for (size_t i = 0; i < arena->len; i++) {
+        Node *node = &(*arena)[i];
+        stack.len = 0;
+        while (is_forward(node) and marks[node->id] == Unseen) {
+            marks[node->id] = Walked;
+            stack.push(node);
+            node = node->edges->node;
+        }
+        if (is_forward(node) and marks[node->id] == Walked) {
+            Node *it = node;
+            do {
+                (*cyclic)[it->id] = true;
+                it = it->edges->node;
+            } while (it != node);
+        }
+        for (Node *walked : stack)
+            marks[walked->id] = Done;
+    }
+}
+
+void Simplifier::fold_eps()
+{
+    Vec<u8> cyclic = new_vec<u8>(arena->len);
+    defer(cyclic.deinit());
+    mark_cycles(&cyclic);
+
+    auto forward = [&](Node *node) { return is_forward(node) and !cyclic[node->id]; };
+
+    for (size_t i = 0; i < arena->len; i++) {
+        Node *node = &(*arena)[i];
+        if (!refs[i] or node->until)
+            continue;
+
+        // the cell is looked at again once it was folded, it may lead to
+        // another epsilon. The edges of an epsilon spliced in place are
+        // skipped when it was folded before, so a chain of alternations is
+        // walked once.
+        Node_Set *last = NULL;
+        for (Node_Set **cell = &node->edges; *cell != NULL;) {
+            Node *eps = (*cell)->node;
+            if (eps->state.option != Regex_Eps or eps->until or eps == node) {
+                last = *cell;
+                cell = &(*cell)->next;
+                continue;
+            }
+
+            bool spliced = true;
+            if (forward(eps)) {
+                Node *next = eps->edges->node;
+                (*cell)->node = next;
+                refs[next->id]++;
+                spliced = false;
+            } else if (!eps->leaf and eps->edges != NULL and refs[eps->id] == 1) {
+                eps->last_edge->next = (*cell)->next;
+                *cell = eps->edges;
+            } else if (eps->leaf and (*cell)->next == NULL and (eps->edges == NULL or refs[eps->id] == 1)) {
+                node->leaf = true;
+                *cell = eps->edges;
+            } else {
+                last = *cell;
+                cell = &(*cell)->next;
+                continue;
+            }
+
+            if (spliced and eps->edges != NULL and eps->id < i)
+                last = eps->last_edge, cell = &last->next;
+            if (spliced)
+                eps->edges = eps->last_edge = NULL;
+            unref(eps);
+        }
+        node->last_edge = node->edges != NULL ? last : NULL;
+    }
+
+    // the head and the sequences of the lookarounds start past their forwards
+    auto skip = [&](Node **start) {
+        while (forward(*start)) {
+            Node *next = (*start)->edges->node;
+            refs[next->id]++;
+            unref(*start);
+            *start = next;
+        }
+    };
+    if (*head != NULL)
+        skip(head);
+    for (size_t i = 0; i < arena->len; i++) {
+        Node *node = &(*arena)[i];
+        if (refs[i] and (node->state.option == Regex_Not or node->state.option == Regex_Dash))
+            skip(&node->state.sequence);
+    }
+}
+
+bool is_byte(const Node *node)
+{
+    switch (node->state.option) {
+    case Regex_Set:
+    case Regex_Scope:
+        return true;
+    case Regex_Str:
+        return node->state.str.len == 1;
+    default:
+        return false;
+    }
+}
+
+bool same_edges(const Node *a, const Node *b)
+{
+    Node_Set *x = a->edges, *y = b->edges;
+    for (; x != NULL and y != NULL; x = x->next, y = y->next) {
+        if (x->node != y->node)
+            return false;
+    }
+    return x == y;
+}
+
+Byte_Set byte_set(const Node *node)
+{
+    return node->state.option == Regex_Str ? new_byte_set(node->state.str) : node->state.set;
+}
+
+// Two branches of one byte next to each other that go on the same way try
+// the byte of the first then the one of the second, which is their union
+void Simplifier::fold_sets()
+{
+    for (size_t i = 0; i < arena->len; i++) {
+        Node *node = &(*arena)[i];
+        if (!refs[i] or node->until)
+            continue;
+
+        for (Node_Set *cell = node->edges; cell != NULL and cell->next != NULL;) {
+            Node *a = cell->node, *b = cell->next->node;
+            bool alone = refs[a->id] == 1 and refs[b->id] == 1 and !fixed[a->id] and !fixed[b->id];
+            if (!alone or !is_byte(a) or !is_byte(b) or a->leaf != b->leaf or !same_edges(a, b)) {
+                cell = cell->next;
+                continue;
+            }
+
+            Byte_Set set = byte_set(a);
+            set.merge(byte_set(b));
+            a->state.option = Regex_Set;
+            a->state.set = set;
+            if (node->last_edge == cell->next)
+                node->last_edge = cell;
+            cell->next = cell->next->next;
+            unref(b);
+        }
+    }
+}
+
+// The string that only 'node' leads to, when 'node' is a string that leads
+// nowhere else
+Node *Simplifier::next_literal(const Node *node) const
+{
+    bool literal = node->state.option == Regex_Str and node->state.str.len > 0 and !fixed[node->id];
+    if (!literal or node->leaf or node->edges == NULL or node->edges->next != NULL)
+        return NULL;
+
+    Node *next = node->edges->node;
+    if (next == node or next->state.option != Regex_Str or next->state.str.len == 0)
+        return NULL;
+    if (refs[next->id] != 1 or fixed[next->id])
+        return NULL;
+    return next;
+}
+
+// A chain of strings is copied once into 'strings' from the string no other
+// one leads to, 'strings' holds as many bytes as the source so it does not move
+void Simplifier::merge_literals(Vec<char> *strings)
+{
+    Vec<u8> merged = new_vec<u8>(arena->len);
+    defer(merged.deinit());
+    merged.reserve_with(arena->len, false);
+    merged.len = arena->len;
+
+    for (size_t i = 0; i < arena->len; i++) {
+        if (Node *next = refs[i] ? next_literal(&(*arena)[i]) : NULL)
+            merged[next->id] = true;
+    }
+
+    for (size_t i = 0; i < arena->len; i++) {
+        Node *node = &(*arena)[i];
+        if (!refs[i] or merged[i] or !next_literal(node))
+            continue;
+
+        size_t begin = strings->len;
+        Node *first = node->edges->node;
+        Node *last = node;
+        for (Node *it = node; it != NULL; it = next_literal(it)) {
+            string str = it->state.str;
+            Assert(strings->len + str.len < strings->cap, "merged strings outgrow the source");
+            strings->concat(str.begin(), str.end());
+            last = it;
+        }
+
+        node->state.str = {&strings->data[begin], strings->len - begin};
+        node->edges = last->edges;
+        node->last_edge = last->last_edge;
+        node->leaf = last->leaf;
+        last->edges = last->last_edge = NULL;
+        for (Node *it = first; it != NULL;) {
+            Node *next = it->edges != NULL ? it->edges->node : NULL;
+            refs[it->id] = 0;
+            it->edges = it->last_edge = NULL;
+            it = it == last ? NULL : next;
+        }
+    }
+}
+
+void simplify(Node_Arena *arena, Node **head, u32 passes, Vec<char> *strings)
+{
+    Simplifier simplifier = new_simplifier(arena, head);
+    defer(simplifier.deinit());
+
+    if (passes & Pass_Dead)
+        simplifier.drop_dead();
+    if (passes & Pass_Eps)
+        simplifier.fold_eps();
+    if (passes & Pass_Sets)
+        simplifier.fold_sets();
+    if (passes & Pass_Eps and passes & Pass_Sets)
+        simplifier.fold_eps();
+    if (passes & Pass_Literals)
+        simplifier.merge_literals(strings);
+}
+
+} // namespace bee::regex
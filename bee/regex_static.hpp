@@ -0,0 +1,261 @@
+#ifndef BEE_REGEX_STATIC_HPP
+#define BEE_REGEX_STATIC_HPP
+
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+// Patterns known at build time are parsed by the compiler, with the grammar of
+// Parser::parse_next_token, into a straight line of strings, sets and any
+// bytes matched by inlined code:
+//
+//   constexpr auto regex = compile_static_regex<"'0x' n n">();
+//   Match match = regex.match(expr);
+//
+// There is no arena, no heap and no startup cost. Operators that branch or
+// loop (!, /, ?, *, +, ~ and | over more than one byte) do not make a
+// straight line, these patterns fail to compile and need compile_regex().
+template <size_t N>
+struct Regex_Literal
+{
+    char data[N];
+
+    consteval Regex_Literal(const char (&s)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+            data[i] = s[i];
+    }
+
+    constexpr u32 len() const
+    {
+        return N - 1;
+    }
+};
+
+struct Static_Item
+{
+    Option option; // Regex_Str, Regex_Set or Regex_Any
+    Byte_Set set;
+    u32 begin; // bytes of Regex_Str in the source
+    u32 len;
+};
+
+// Every item takes at least one byte of the source
+template <size_t N>
+struct Static_Pattern
+{
+    Static_Item items[N];
+    u32 len;
+    bool ok;
+};
+
+consteval Byte_Set static_byte_set(const char *s)
+{
+    Byte_Set set = {};
+    for (; *s; s++)
+        set.insert(*s);
+    return set;
+}
+
+consteval bool static_is_byte_set(const Static_Item &item)
+{
+    return item.option == Regex_Set or (item.option == Regex_Str and item.len == 1);
+}
+
+template <size_t N>
+struct Static_Parser
+{
+    const char *source;
+    Static_Pattern<N> pattern;
+
+    // Parses source[begin, end), returns false when the pattern is not a straight line
+    consteval bool parse(u32 begin, u32 end)
+    {
+        // first item of the last sequence, the pre-operand of '|'
+        u32 last = (u32)npos;
+
+        for (u32 i = begin; i < end; i++) {
+            u32 first = pattern.len;
+
+            switch (source[i]) {
+            case ' ':
+            case '\f':
+            case '\n':
+            case '\r':
+            case '\t':
+            case '\v':
+                continue;
+
+            case '|': {
+                if (last == (u32)npos or pattern.len - last != 1)
+                    return false;
+                u32 token = pattern.len;
+                if (!parse_token(&i, end) or pattern.len - token != 1)
+                    return false;
+
+                // {'_'|a|[0-9]} is one set as in Parser::parse_set_or
+                Static_Item &a = pattern.items[last];
+                Static_Item &b = pattern.items[token];
+                if (!static_is_byte_set(a) or !static_is_byte_set(b))
+                    return false;
+                Static_Item items[] = {a, b};
+                a.option = Regex_Set;
+                a.set = {};
+                for (const Static_Item &item : items)
+                    item.option == Regex_Str ? a.set.insert(source[item.begin]) : a.set.merge(item.set);
+                pattern.len--;
+                continue;
+            }
+
+            default:
+                i--;
+                if (!parse_token(&i, end))
+                    return false;
+                break;
+            }
+
+            // an empty sequence is not pushed
+            if (pattern.len > first)
+                last = first;
+        }
+        return true;
+    }
+
+    // Parses the token after *i and moves *i to its last byte
+    consteval bool parse_token(u32 *i, u32 end)
+    {
+        u32 at = *i + 1;
+        while (at < end and (source[at] == ' ' or (source[at] >= '\t' and source[at] <= '\r')))
+            at++;
+        if (at >= end)
+            return false;
+        *i = at;
+
+        Static_Item item = {};
+        switch (source[at]) {
+        case '_':
+            item = {Regex_Set, static_byte_set(" \v\b\f\t"), 0, 0};
+            break;
+        case 'a':
+            item = {Regex_Set, static_byte_set("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"), 0, 0};
+            break;
+        case 'o':
+            item = {Regex_Set, static_byte_set("!#$%&()*+,-./:;<=>?@[\\]^`{|}~"), 0, 0};
+            break;
+        case 'n':
+            item = {Regex_Set, static_byte_set("0123456789"), 0, 0};
+            break;
+        case 'Q':
+            item = {Regex_Set, static_byte_set("\""), 0, 0};
+            break;
+        case 'q':
+            item = {Regex_Set, static_byte_set("'"), 0, 0};
+            break;
+
+        case '[':
+            if (end - at < 5 or source[at + 2] != '-' or source[at + 4] != ']')
+                return false;
+            item = {Regex_Set, {}, 0, 0};
+            item.set.insert(source[at + 1], source[at + 3]);
+            *i = at + 4;
+            break;
+
+        case '^':
+            item = {Regex_Any, {}, 0, 0};
+            break;
+
+        case '\'':
+        case '`': {
+            u32 close = at + 1;
+            while (close < end and source[close] != source[at])
+                close++;
+            if (close >= end)
+                return false;
+            item = {Regex_Str, {}, at + 1, close - at - 1};
+            *i = close;
+            break;
+        }
+
+        case '{': {
+            i32 depth = 1;
+            u32 close = at + 1;
+            for (; close < end and depth > 0; close++)
+                depth += source[close] == '{' ? 1 : source[close] == '}' ? -1 : 0;
+            if (depth > 0)
+                return false;
+            *i = close - 1;
+            return parse(at + 1, close - 1);
+        }
+
+        default:
+            return false;
+        }
+
+        pattern.items[pattern.len++] = item;
+        return true;
+    }
+};
+
+template <Regex_Literal Source>
+consteval Static_Pattern<Source.len() + 1> parse_static_pattern()
+{
+    Static_Parser<Source.len() + 1> parser = {Source.data, {}};
+    parser.pattern.ok = parser.parse(0, Source.len());
+    return parser.pattern;
+}
+
+template <Regex_Literal Source>
+struct Static_Regex
+{
+    static constexpr Static_Pattern<Source.len() + 1> pattern = parse_static_pattern<Source>();
+    static_assert(pattern.ok, "regex is not a straight line of strings and sets, use compile_regex()");
+
+    // Same result as Regex::match on the compiled regex
+    template <u32 I>
+    static u64 submit_item(string expr, u64 n)
+    {
+        if constexpr (I == pattern.len) {
+            return n;
+        } else {
+            constexpr Static_Item item = pattern.items[I];
+            if (n >= expr.len)
+                return npos;
+
+            if constexpr (item.option == Regex_Str) {
+                if (expr.len - n < item.len or memcmp(&expr.data[n], &Source.data[item.begin], item.len))
+                    return npos;
+                return submit_item<I + 1>(expr, n + item.len);
+            } else if constexpr (item.option == Regex_Set) {
+                if (!item.set.has(expr.data[n]))
+                    return npos;
+                return submit_item<I + 1>(expr, n + 1);
+            } else {
+                return submit_item<I + 1>(expr, n + 1);
+            }
+        }
+    }
+
+    static u64 submit(string expr)
+    {
+        if constexpr (pattern.len == 0)
+            return npos;
+        else
+            return submit_item<0>(expr, 0);
+    }
+
+    static Match match(string expr)
+    {
+        return new_match(expr, submit(expr));
+    }
+};
+
+template <Regex_Literal Source>
+consteval Static_Regex<Source> compile_static_regex()
+{
+    return {};
+}
+
+} // namespace bee::regex
+
+#endif
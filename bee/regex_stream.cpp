@@ -0,0 +1,171 @@
+#include "regex_stream.hpp"
+
+namespace bee::regex
+{
+
+void Stream::deinit()
+{
+    prog.deinit();
+    clist.deinit();
+    nlist.deinit();
+    stack.deinit();
+    cstarts.deinit();
+    nstarts.deinit();
+    replay.deinit();
+    rescan.deinit();
+}
+
+void Stream::submit(string chunk, Vec<Stream_Match> *matches)
+{
+    scan(chunk, matches, false);
+}
+
+// Reports the matches left at the end of the stream, the stream starts over
+void Stream::finish(Vec<Stream_Match> *matches)
+{
+    scan({}, matches, true);
+
+    clist.clear();
+    replay.len = 0;
+    rescan.len = 0;
+    cursor = 0;
+    offset = 0, from = 0;
+    ready = false;
+    pending = {npos, npos, false};
+}
+
+void Stream::scan(string chunk, Vec<Stream_Match> *matches, bool last)
+{
+    size_t i = 0;
+
+    for (;;) {
+        if (!ready)
+            inject();
+
+        if (pending.begin != npos and clist.empty()) {
+            restart(matches);
+            continue;
+        }
+
+        if (cursor < rescan.len) {
+            step(rescan[cursor++]);
+        } else if (i < chunk.len) {
+            step(chunk[i++]);
+        } else if (last and pending.begin != npos) {
+            // no thread goes further than the end of the stream
+            clist.clear();
+        } else {
+            break;
+        }
+
+        // the threads that could extend the match are dropped, the kept
+        // bytes may still hold the next one
+        if (replay.len > window) {
+            clist.clear();
+            pending.truncated = true;
+            restart(matches);
+        }
+    }
+
+    rescan.len = 0;
+    cursor = 0;
+}
+
+// Starts a thread at 'offset' with the lowest priority until a match is found
+void Stream::inject()
+{
+    ready = true;
+    if (pending.begin != npos or offset < from)
+        return;
+
+    u32 len = clist.len;
+    bool accept = prog.closure(prog.start, &clist, &stack);
+    for (u32 i = len; i < clist.len; i++)
+        cstarts[clist.dense[i]] = offset;
+    if (accept) {
+        pending = {offset, offset, false};
+        replay.len = 0;
+    }
+}
+
+void Stream::step(u8 c)
+{
+    bool accept = false;
+    nlist.clear();
+
+    for (u32 pc : clist) {
+        const Inst &inst = prog.insts[pc];
+        if (!inst.step(c))
+            continue;
+
+        u32 len = nlist.len;
+        accept = prog.closure(inst.x, &nlist, &stack);
+        for (u32 i = len; i < nlist.len; i++)
+            nstarts[nlist.dense[i]] = cstarts[pc];
+
+        // lower priority threads are cut by the match
+        if (accept) {
+            pending = {cstarts[pc], offset + 1, false};
+            replay.len = 0;
+            break;
+        }
+    }
+
+    if (pending.begin != npos and !accept)
+        replay.push(c);
+
+    Sparse_Set list = clist;
+    clist = nlist;
+    nlist = list;
+    Vec<u64> starts = cstarts;
+    cstarts = nstarts;
+    nstarts = starts;
+    offset++;
+    ready = false;
+}
+
+// Reports the settled match, the search goes back to its end and the bytes
+// after it are scanned again before the rest of the input
+void Stream::restart(Vec<Stream_Match> *matches)
+{
+    matches->push(pending);
+
+    replay.concat(rescan.begin() + cursor, rescan.end());
+    Vec<char> next = replay;
+    replay = rescan;
+    rescan = next;
+    replay.len = 0;
+    cursor = 0;
+
+    offset = pending.end;
+    from = pending.end + (pending.begin == pending.end);
+    pending = {npos, npos, false};
+    ready = false;
+}
+
+bool compile_stream(const Regex *regex, Stream *stream, size_t window)
+{
+    Prog prog = compile_prog(&regex->arena, regex->node_head);
+    if (prog.has_lookaround) {
+        prog.deinit();
+        return false;
+    }
+
+    u32 len = prog.insts.len;
+    *stream = {};
+    stream->prog = prog;
+    stream->clist = new_sparse_set(len);
+    stream->nlist = new_sparse_set(len);
+    stream->stack = new_vec<u32>(16);
+    stream->cstarts = new_vec<u64>(len);
+    stream->nstarts = new_vec<u64>(len);
+    stream->cstarts.len = len;
+    stream->nstarts.len = len;
+    stream->replay = new_vec<char>(64);
+    stream->rescan = new_vec<char>(64);
+    stream->window = window;
+    stream->pending = {npos, npos, false};
+    return true;
+}
+
+} // namespace bee::regex
@@ -0,0 +1,63 @@
+#ifndef BEE_REGEX_STREAM_HPP
+#define BEE_REGEX_STREAM_HPP
+
+#include "regex.hpp"
+
+namespace bee::regex
+{
+
+// Matches of Regex::find_all over input fed in chunks, reported as absolute
+// offsets of the stream. The threads of the program and the start of their
+// match are carried from one chunk to the next.
+//
+// The bytes after the end of the best match so far are kept until the match
+// is settled, the search restarts there. They are bounded by 'window': when
+// it fills the match is reported as is, marked truncated as find_all may have
+// made it longer, and the kept bytes are searched again from its end. A match
+// reported this way costs up to 'window' bytes scanned twice.
+//
+// The input is only read forward, lookaround is not supported.
+const size_t Stream_Window = 64 << 10;
+
+struct Stream_Match
+{
+    u64 begin;
+    u64 end;
+    bool truncated; // the window filled before the match was settled
+};
+
+struct Stream
+{
+    Prog prog;
+    Sparse_Set clist;
+    Sparse_Set nlist;
+    Vec<u32> stack;
+    Vec<u64> cstarts;
+    Vec<u64> nstarts;
+    Vec<char> replay;
+    Vec<char> rescan;
+    size_t cursor;
+    size_t window;
+
+    u64 offset; // absolute offset of the next byte
+    u64 from;   // first offset a match can start at
+    bool ready; // the threads starting at 'offset' are added
+    Stream_Match pending;
+
+    void deinit();
+    void submit(string chunk, Vec<Stream_Match> *matches);
+    void finish(Vec<Stream_Match> *matches);
+
+    void scan(string chunk, Vec<Stream_Match> *matches, bool last);
+    void inject();
+    void step(u8 c);
+    void restart(Vec<Stream_Match> *matches);
+};
+
+// The program of 'regex' is copied, the stream does not refer to it. Fails
+// when the regex has lookaround.
+bool compile_stream(const Regex *regex, Stream *stream, size_t window = Stream_Window);
+
+} // namespace bee::regex
+
+#endif
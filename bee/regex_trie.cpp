@@ -0,0 +1,223 @@
+#include "regex_trie.hpp"
+
+namespace bee::regex
+{
+
+void Trie::deinit()
+{
+    base.deinit();
+    check.deinit();
+    ends.deinit();
+    branches.deinit();
+    depth.deinit();
+    fail.deinit();
+    output.deinit();
+}
+
+// Lowest rank from 'from' among the branches whose literal starts at 'n'
+u32 Trie::next(string expr, u64 n, u32 from) const
+{
+    u32 first = Trie_None;
+    u32 s = 0;
+    for (; n < expr.len; n++) {
+        u64 t = (u64)base.data[s] + (u8)expr.data[n];
+        if (t >= check.len or check.data[t] != s)
+            break;
+        s = t;
+        for (u32 i = ends.data[s]; i < ends.data[s + 1]; i++) {
+            if (branches.data[i] >= from) {
+                first = Min(first, branches.data[i]);
+                break;
+            }
+        }
+    }
+    return first;
+}
+
+// Leftmost offset from 'from' where a key starts, npos without one. The walk
+// stops once no key still being read can start before the best one found.
+u64 Trie::first_start(string expr, u64 from) const
+{
+    u64 first = npos;
+    u32 s = 0;
+    for (u64 n = from; n < expr.len; n++) {
+        u8 c = expr.data[n];
+        for (;;) {
+            u64 t = (u64)base.data[s] + c;
+            if (t < check.len and check.data[t] == s) {
+                s = t;
+                break;
+            }
+            if (s == 0)
+                break;
+            s = fail.data[s];
+        }
+
+        u32 out = output.data[s];
+        if (out != Trie_None)
+            first = Min(first, n + 1 - depth.data[out]);
+        if (first != npos and n + 1 - depth.data[s] >= first)
+            return first;
+    }
+    return first;
+}
+
+// State of the trie while it is built, the children are a list
+struct Trie_Node
+{
+    u32 child;
+    u32 sibling;
+    u32 slot;
+    u8 byte;
+};
+
+// First free slot from 't', an occupied slot points past itself and the
+// paths are compressed as they are walked
+u32 next_free(Vec<u32> *skip, u32 t)
+{
+    u32 free = t;
+    while (free < skip->len and (*skip)[free] != free)
+        free = (*skip)[free];
+    while (t < skip->len and (*skip)[t] != t) {
+        u32 next = (*skip)[t];
+        (*skip)[t] = free;
+        t = next;
+    }
+    return free;
+}
+
+// The links are set breadth first, the fail of a child is reached from the
+// fail of its parent, which is shallower and already linked
+void link_trie(Trie *trie, const Vec<Trie_Node> *nodes, const Vec<u32> *queue)
+{
+    size_t slots = trie->check.len;
+    trie->depth = new_vec<u32>(slots);
+    trie->fail = new_vec<u32>(slots);
+    trie->output = new_vec<u32>(slots);
+    trie->depth.reserve_with(slots, 0);
+    trie->fail.reserve_with(slots, 0);
+    trie->output.reserve_with(slots, Trie_None);
+    trie->depth.len = trie->fail.len = trie->output.len = slots;
+
+    for (u32 u : *queue) {
+        u32 s = (*nodes)[u].slot;
+        for (u32 child = (*nodes)[u].child; child != Trie_None; child = (*nodes)[child].sibling) {
+            u32 t = (*nodes)[child].slot;
+            u8 c = (*nodes)[child].byte;
+            u32 f = 0;
+            for (u32 k = s; k != 0;) {
+                k = trie->fail[k];
+                u64 next = (u64)trie->base[k] + c;
+                if (next < slots and trie->check[next] == k) {
+                    f = next;
+                    break;
+                }
+            }
+            trie->depth[t] = trie->depth[s] + 1;
+            trie->fail[t] = f;
+            trie->output[t] = trie->ends[t] < trie->ends[t + 1] ? t : trie->output[f];
+        }
+    }
+}
+
+// The keys are inserted into a trie of lists, which is then placed into the
+// double array breadth first, each state at the first base where all of its
+// children land on free slots. Slot 0 is the root and no one's child.
+Trie compile_trie(View<Trie_Key> keys, bool unanchored)
+{
+    Vec<Trie_Node> nodes = new_vec<Trie_Node>(64);
+    Vec<u32> key_nodes = new_vec<u32>(keys.len);
+    defer(nodes.deinit(); key_nodes.deinit());
+
+    nodes.push({Trie_None, Trie_None, 0, 0});
+    for (const Trie_Key &key : keys) {
+        u32 s = 0;
+        for (size_t i = 0; i < key.str.len; i++) {
+            u8 c = key.str.data[i];
+            u32 child = nodes[s].child;
+            while (child != Trie_None and nodes[child].byte != c)
+                child = nodes[child].sibling;
+            if (child == Trie_None) {
+                child = nodes.len;
+                nodes.push({Trie_None, nodes[s].child, 0, c});
+                nodes[s].child = child;
+            }
+            s = child;
+        }
+        key_nodes.push(s);
+    }
+
+    Trie trie = {};
+    trie.base = new_vec<u32>(nodes.len * 2);
+    trie.check = new_vec<u32>(nodes.len * 2);
+    trie.base.push(0);
+    trie.check.push(Trie_Free);
+
+    Vec<u32> queue = new_vec<u32>(nodes.len);
+    Vec<u32> skip = new_vec<u32>(nodes.len * 2);
+    defer(queue.deinit(); skip.deinit());
+    queue.push(0);
+    skip.push(1);
+
+    for (size_t q = 0; q < queue.len; q++) {
+        Trie_Node node = nodes[queue[q]];
+        if (node.child == Trie_None)
+            continue;
+
+        u32 low = 255, high = 0;
+        for (u32 child = node.child; child != Trie_None; child = nodes[child].sibling)
+            low = Min(low, (u32)nodes[child].byte), high = Max(high, (u32)nodes[child].byte);
+
+        // the lowest child is tried on the free slots only
+        u32 base = 0;
+        for (u32 free = next_free(&skip, low + 1);; free = next_free(&skip, free + 1)) {
+            base = free - low;
+            u32 child = node.child;
+            for (; child != Trie_None; child = nodes[child].sibling) {
+                u32 t = base + nodes[child].byte;
+                if (t < trie.check.len and trie.check[t] != Trie_Free)
+                    break;
+            }
+            if (child == Trie_None)
+                break;
+        }
+
+        while (trie.check.len < base + high + 1) {
+            skip.push(trie.check.len);
+            trie.base.push(0);
+            trie.check.push(Trie_Free);
+        }
+        trie.base[node.slot] = base;
+        for (u32 child = node.child; child != Trie_None; child = nodes[child].sibling) {
+            u32 t = base + nodes[child].byte;
+            trie.check[t] = node.slot;
+            skip[t] = t + 1;
+            nodes[child].slot = t;
+            queue.push(child);
+        }
+    }
+
+    // the branches of a slot keep the order of the keys, that is their rank
+    size_t slots = trie.check.len;
+    trie.ends = new_vec<u32>(slots + 1);
+    trie.ends.reserve_with(slots + 1, 0);
+    trie.ends.len = slots + 1;
+    for (u32 s : key_nodes)
+        trie.ends[nodes[s].slot + 1]++;
+    for (size_t i = 0; i < slots; i++)
+        trie.ends[i + 1] += trie.ends[i];
+
+    Vec<u32> cursors = new_vec<u32>(slots);
+    defer(cursors.deinit());
+    cursors.concat(trie.ends.data, trie.ends.data + slots);
+    trie.branches = new_vec<u32>(keys.len);
+    trie.branches.len = keys.len;
+    for (size_t i = 0; i < keys.len; i++)
+        trie.branches[cursors[nodes[key_nodes[i]].slot]++] = keys[i].branch;
+
+    if (unanchored)
+        link_trie(&trie, &nodes, &queue);
+    return trie;
+}
+
+} // namespace bee::regex
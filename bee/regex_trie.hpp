@@ -0,0 +1,50 @@
+#ifndef BEE_REGEX_TRIE_HPP
+#define BEE_REGEX_TRIE_HPP
+
+#include "ds.hpp"
+
+namespace bee::regex
+{
+
+const u32 Trie_Free = (u32)-1;
+const u32 Trie_None = (u32)-1;
+
+// Literal of the branch ranked 'branch' in an alternation
+struct Trie_Key
+{
+    string str;
+    u32 branch;
+};
+
+// Double-array trie of the literal branches of an alternation. The child of
+// state s by byte c is t = base[s] + c when check[t] == s, the root is state
+// 0. The branches whose literal ends at t are branches[ends[t]..ends[t + 1]]
+// in rank order, the branches that start at an offset are found in one walk
+// of the input whatever their count.
+//
+// An unanchored trie also has the Aho-Corasick links: 'fail' is the longest
+// proper suffix of a state that is a state too and 'output' the state of the
+// longest key that ends there. It finds where the keys start in a haystack
+// in one pass, whatever their count.
+struct Trie
+{
+    Vec<u32> base;
+    Vec<u32> check;
+    Vec<u32> ends;
+    Vec<u32> branches;
+    Vec<u32> depth;
+    Vec<u32> fail;
+    Vec<u32> output;
+    u32 span; // the branches below are the ones in the trie
+
+    void deinit();
+    u32 next(string expr, u64 n, u32 from) const;
+    u64 first_start(string expr, u64 from) const;
+};
+
+// 'keys' are in rank order, a branch can have several keys
+Trie compile_trie(View<Trie_Key> keys, bool unanchored = false);
+
+} // namespace bee::regex
+
+#endif
@@ -0,0 +1,78 @@
+#include "thread_pool.hpp"
+
+namespace bee
+{
+
+void Thread_Pool::deinit()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (u32 i = 0; i < len; i++)
+        threads[i].join();
+    delete[] threads;
+    delete this;
+}
+
+void Thread_Pool::run(u32 count, Thread_Fn fn, void *data)
+{
+    std::lock_guard<std::mutex> serial(submit);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = Thread_Job{fn, data, count};
+        next = 0;
+        busy = len;
+        generation++;
+    }
+    wake.notify_all();
+
+    for (u32 i = next++; i < count; i = next++)
+        fn(data, i);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&] { return busy == 0; });
+}
+
+void Thread_Pool::work()
+{
+    u64 seen = 0;
+    for (;;) {
+        Thread_Job current = {};
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return quit or generation != seen; });
+            if (quit)
+                return;
+            seen = generation;
+            current = job;
+        }
+
+        for (u32 i = next++; i < current.count; i = next++)
+            current.fn(current.data, i);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--busy == 0)
+            done.notify_one();
+    }
+}
+
+u32 Thread_Pool::size() const
+{
+    return len + 1;
+}
+
+Thread_Pool *new_thread_pool(u32 len)
+{
+    if (len == 0)
+        len = Max(std::thread::hardware_concurrency(), 1u);
+
+    auto pool = new Thread_Pool{};
+    pool->threads = new std::thread[len - 1];
+    for (u32 i = 0; i + 1 < len; i++)
+        pool->threads[pool->len++] = std::thread(&Thread_Pool::work, pool);
+    return pool;
+}
+
+} // namespace bee
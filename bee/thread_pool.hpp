@@ -0,0 +1,49 @@
+#ifndef BEE_THREAD_POOL_HPP
+#define BEE_THREAD_POOL_HPP
+
+#include "ds.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace bee
+{
+
+// Fixed set of worker threads running one indexed job at a time, the thread
+// calling run() works on the job as well and returns once every index is done
+typedef void (*Thread_Fn)(void *data, u32 index);
+
+struct Thread_Job
+{
+    Thread_Fn fn;
+    void *data;
+    u32 count;
+};
+
+struct Thread_Pool
+{
+    std::thread *threads; // Vec moves its items with memcpy, a thread cannot be moved that way
+    u32 len;
+    std::mutex lock;
+    std::mutex submit;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::atomic<u32> next;
+    Thread_Job job;
+    u64 generation;
+    u32 busy;
+    bool quit;
+
+    void deinit();
+    void run(u32 count, Thread_Fn fn, void *data);
+    void work();
+    u32 size() const;
+};
+
+// 'len' threads with the caller, 0 takes one per hardware thread
+Thread_Pool *new_thread_pool(u32 len = 0);
+
+} // namespace bee
+
+#endif
@@ -0,0 +1,69 @@
+#include "bench.hpp"
+#include "regex.hpp"
+
+namespace bee
+{
+
+struct Backtrack_Bench
+{
+    string source;
+    string expr;
+};
+
+// bee-bench backtrack
+// Time per match of Engine_Backtrack on short inputs, then its throughput
+// over single lines of 1 to 64 MiB that the whole pattern walks through
+void bench_backtrack()
+{
+    using namespace regex;
+
+    const Backtrack_Bench Shorts[] = {
+        {"{a|n|'_'}+", "identifier_42"},
+        {"n+ '.' n+", "3.14159"},
+        {"'//' {a|' '} ~ '//'", "// The program starts here // int main() {"},
+        {"{a+ '@'} a+ {'.' a+}+", "someone@example.co.uk"},
+        {"!'x'* 'x'", "aaaaaaaaaaaaaaaaaaaay"},
+    };
+    const u32 Rounds = 1'000'000;
+
+    for (const Backtrack_Bench &bench : Shorts) {
+        Regex regex = compile_regex(bench.source);
+        defer(regex.deinit());
+
+        u64 matched = 0;
+        struct timespec start = {};
+        timespec_get(&start, TIME_UTC);
+        for (u32 i = 0; i < Rounds; i++)
+            matched += regex.match(bench.expr).ok;
+        f64 seconds = elapsed_since(start) / Rounds;
+
+        fmt::print("%(s:< 24) %(d:> 3) bytes :: %(f:.1) ns/match (%d)\n", bench.source, bench.expr.len, seconds * 1e9,
+                   matched);
+    }
+
+    const string Longs[] = {"{!';'}*", "n+"};
+    const u32 Megabytes[] = {1, 16, 64};
+
+    for (string source : Longs) {
+        Regex regex = compile_regex(source);
+        defer(regex.deinit());
+
+        for (u32 megabytes : Megabytes) {
+            u64 len = (u64)megabytes << 20;
+            Vec<char> buf = new_vec<char>(len);
+            defer(buf.deinit());
+            buf.reserve_with(len, '7');
+            buf.len = len;
+
+            struct timespec start = {};
+            timespec_get(&start, TIME_UTC);
+            Match match = regex.match(string{buf.data, buf.len});
+            f64 seconds = elapsed_since(start);
+
+            string check = match.view.len == len ? "ok" : "wrong match";
+            fmt::print("%(s:< 24) %(d:> 3) MiB :: %(f:.1) MiB/s (%s)\n", source, megabytes, megabytes / seconds, check);
+        }
+    }
+}
+
+} // namespace bee
@@ -0,0 +1,17 @@
+#ifndef BEE_BENCH_HPP
+#define BEE_BENCH_HPP
+
+#include "format.hpp"
+#include <time.h>
+
+namespace bee
+{
+
+f64 elapsed_since(struct timespec start);
+void bench_compile();
+void bench_backtrack();
+void bench_keywords();
+
+} // namespace bee
+
+#endif
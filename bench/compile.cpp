@@ -0,0 +1,69 @@
+#include "bench.hpp"
+#include "regex.hpp"
+
+namespace bee
+{
+
+// Patterns of 'len' operand tokens, every shape should compile in time
+// linear to its length
+void make_keywords(Vec<char> *buf, u32 len)
+{
+    fmt::Vec_Device dev = {};
+    dev.vec = buf;
+    for (u32 i = 0; i < len; i++)
+        dev.format(i == 0 ? "'k%d'" : "|'k%d'", i);
+}
+
+void make_sequence(Vec<char> *buf, u32 len)
+{
+    const string Atoms[] = {"a ", "n ", "'xy' ", "[a-f] ", "_? ", "o+ "};
+    for (u32 i = 0; i < len; i++)
+        buf->concat(Atoms[i % 6].begin(), Atoms[i % 6].end());
+}
+
+struct Compile_Bench
+{
+    string name;
+    void (*make)(Vec<char> *buf, u32 len);
+};
+
+// bee-bench compile
+// Compile time of the graph and prefilter (Engine_Backtrack) and of the
+// program (Engine_Pike) from 10 to 100'000 tokens
+void bench_compile()
+{
+    using namespace regex;
+
+    const Compile_Bench Benches[] = {
+        {"keywords", make_keywords},
+        {"sequence", make_sequence},
+    };
+    const u32 Lens[] = {10, 1'000, 100'000};
+    const Engine Engines[] = {Engine_Backtrack, Engine_Pike};
+
+    for (const Compile_Bench &bench : Benches) {
+        for (u32 len : Lens) {
+            Vec<char> buf = new_vec<char>(len * 8);
+            defer(buf.deinit());
+            bench.make(&buf, len);
+            string source = {buf.data, buf.len};
+
+            for (Engine engine : Engines) {
+                u32 rounds = Max(100'000 / len, 1u);
+                struct timespec start = {};
+                timespec_get(&start, TIME_UTC);
+                for (u32 i = 0; i < rounds; i++) {
+                    Regex regex = compile_regex(source, engine);
+                    regex.deinit();
+                }
+                f64 seconds = elapsed_since(start) / rounds;
+
+                string engine_name = engine == Engine_Pike ? "pike" : "backtrack";
+                fmt::print("%(s:< 9) %(s:< 9) %(d:> 7) tokens :: %(f:.3) ms, %(f:.1) ns/token\n", bench.name,
+                           engine_name, len, seconds * 1e3, seconds * 1e9 / len);
+            }
+        }
+    }
+}
+
+} // namespace bee
@@ -0,0 +1,101 @@
+#include "bench.hpp"
+#include "regex.hpp"
+
+namespace bee
+{
+
+// Words of 4 to 10 lowercase letters, the same ones on every run
+void push_word(Vec<char> *buf, u64 *seed)
+{
+    *seed = *seed * 6364136223846793005 + 1442695040888963407;
+    u32 len = 4 + (*seed >> 33) % 7;
+    for (u32 i = 0; i < len; i++) {
+        *seed = *seed * 6364136223846793005 + 1442695040888963407;
+        buf->push('a' + (*seed >> 33) % 26);
+    }
+}
+
+// bee-bench keywords
+// Time per match of an alternation of 16 to 4096 keywords on Engine_Backtrack,
+// half of the inputs are keywords and half are other words. Then the time of
+// find_all over 1 MiB of these inputs, one after another.
+void bench_keywords()
+{
+    using namespace regex;
+
+    const u32 Counts[] = {16, 256, 4096};
+    const u32 Inputs = 1024;
+    const u32 Rounds = 1'000'000;
+    const size_t Haystack_Len = 1 << 20;
+
+    for (u32 count : Counts) {
+        Vec<char> source = new_vec<char>(count * 16);
+        Vec<u32> words = new_vec<u32>(count * 2);
+        defer(source.deinit(); words.deinit());
+
+        u64 seed = count;
+        source.push('{');
+        for (u32 i = 0; i < count; i++) {
+            if (i > 0)
+                source.push('|');
+            source.push('\'');
+            words.push(source.len);
+            push_word(&source, &seed);
+            words.push(source.len);
+            source.push('\'');
+        }
+        // a keyword matches when no letter follows, the inputs end in a space
+        string tail = "} !a";
+        source.concat(tail.begin(), tail.end());
+
+        Vec<char> buf = new_vec<char>(Inputs * 12);
+        Vec<string> inputs = new_vec<string>(Inputs);
+        Vec<u32> offsets = new_vec<u32>(Inputs + 1);
+        defer(buf.deinit(); inputs.deinit(); offsets.deinit());
+        for (u32 i = 0; i < Inputs; i++) {
+            offsets.push(buf.len);
+            if (i % 2 == 0) {
+                u32 k = (seed >> 33) % count;
+                seed = seed * 6364136223846793005 + 1442695040888963407;
+                buf.concat(&source.data[words[k * 2]], &source.data[words[k * 2 + 1]]);
+            } else {
+                push_word(&buf, &seed);
+            }
+            buf.push(' ');
+        }
+        offsets.push(buf.len);
+        for (u32 i = 0; i < Inputs; i++)
+            inputs.push(string{&buf.data[offsets[i]], offsets[i + 1] - offsets[i]});
+
+        struct timespec start = {};
+        timespec_get(&start, TIME_UTC);
+        Regex regex = compile_regex(string{source.data, source.len});
+        defer(regex.deinit());
+        f64 compile = elapsed_since(start);
+
+        u64 matched = 0;
+        timespec_get(&start, TIME_UTC);
+        for (u32 i = 0; i < Rounds; i++)
+            matched += regex.match(inputs[i % Inputs]).ok;
+        f64 seconds = elapsed_since(start) / Rounds;
+
+        fmt::print("%(d:> 5) keywords :: %(f:.1) ns/match, compiled in %(f:.2) ms (%d)\n", count, seconds * 1e9,
+                   compile * 1e3, matched);
+
+        Vec<char> haystack = new_vec<char>(Haystack_Len + buf.len);
+        defer(haystack.deinit());
+        while (haystack.len < Haystack_Len)
+            haystack.concat(buf.begin(), buf.end());
+
+        u64 found = 0;
+        timespec_get(&start, TIME_UTC);
+        for (const Match &match : regex.find_all(string{haystack.data, haystack.len}))
+            found += match.ok;
+        seconds = elapsed_since(start);
+
+        fmt::print("%(d:> 5) keywords :: %(f:.1) MiB/s find_all (%d)\n", count, (haystack.len / (f64)(1 << 20)) / seconds,
+                   found);
+    }
+}
+
+} // namespace bee
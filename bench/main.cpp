@@ -0,0 +1,74 @@
+#include "bench.hpp"
+#include "regex_parallel.hpp"
+
+using namespace bee;
+
+// bee-bench [megabytes] [threads]
+// bee-bench compile
+// bee-bench backtrack
+// bee-bench keywords
+// Throughput of match_parallel over one large input from 1 to 'threads',
+// every hardware thread by default
+const string Bench_Text = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+                          "incididunt ut labore et dolore magna aliqua. 0123456789\n";
+
+f64 bee::elapsed_since(struct timespec start)
+{
+    struct timespec end = {};
+    timespec_get(&end, TIME_UTC);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace regex;
+
+    if (argc > 1 and string{argv[1]} == "compile") {
+        bench_compile();
+        return 0;
+    }
+    if (argc > 1 and string{argv[1]} == "backtrack") {
+        bench_backtrack();
+        return 0;
+    }
+    if (argc > 1 and string{argv[1]} == "keywords") {
+        bench_keywords();
+        return 0;
+    }
+
+    u64 megabytes = argc > 1 ? strtoull(argv[1], NULL, 10) : 256;
+    u64 len = Max(megabytes, (u64)1) << 20;
+
+    Vec<char> buf = new_vec<char>(len + Bench_Text.len);
+    defer(buf.deinit());
+    while (buf.len < len)
+        buf.concat(Bench_Text.begin(), Bench_Text.end());
+    string text = {buf.data, buf.len};
+
+    // the whole input matches, every byte is read
+    Regex regex = compile_regex("{a|n|o|_|`\n`}*", Engine_Dfa);
+    defer(regex.deinit());
+
+    u32 cores = argc > 2 ? strtoul(argv[2], NULL, 10) : std::thread::hardware_concurrency();
+    cores = Max(cores, 1u);
+    f64 base = 0;
+    fmt::print("%d MiB, up to %d threads\n", len >> 20, cores);
+
+    for (u32 threads = 1; threads <= cores; threads *= 2) {
+        Thread_Pool *pool = new_thread_pool(threads);
+        defer(pool->deinit());
+
+        struct timespec start = {};
+        timespec_get(&start, TIME_UTC);
+        Match match = match_parallel(&regex, text, pool);
+        f64 seconds = elapsed_since(start);
+
+        if (threads == 1)
+            base = seconds;
+        string check = match.view.len == text.len ? "ok" : "wrong match";
+        fmt::print("threads %(d:> 3) :: %(f:.1) MiB/s, %(f:.2)x (%s)\n", threads, (len >> 20) / seconds, base / seconds,
+                   check);
+        if (threads < cores and threads * 2 > cores)
+            threads = cores / 2;
+    }
+}
@@ -0,0 +1,152 @@
+#include "regex_codegen.hpp"
+
+using namespace bee;
+
+// bee-regen <rules> <output>
+// Every line of <rules> names a regex: '<name> <source>', blank lines and
+// lines starting with '#' are skipped. Writes the matchers to <output>.cpp,
+// their declarations to <output>.hpp and the regex graphs to <output>.dot.
+struct Rule
+{
+    string name;
+    string source;
+};
+
+bool is_name(string name)
+{
+    if (name.empty() or isdigit(name[0]))
+        return false;
+    for (char c : name) {
+        if (!isalnum(c) and c != '_')
+            return false;
+    }
+    return true;
+}
+
+bool read_file(const char *path, Vec<char> *buf)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    defer(fclose(f));
+
+    char chunk[4096];
+    size_t len = 0;
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        buf->concat(chunk, chunk + len);
+    return true;
+}
+
+bool parse_rules(string text, Vec<Rule> *rules)
+{
+    u32 line_no = 0;
+    while (!text.empty()) {
+        string line = text.end_at(text.find('\n'));
+        text = text.begin_at(line.end() < text.end() ? line.end() + 1 : line.end());
+        line_no++;
+
+        while (!line.empty() and isspace(line[line.len - 1]))
+            line.len--;
+        while (!line.empty() and isspace(line[0]))
+            line = line.begin_at(line.begin() + 1);
+        if (line.empty() or line[0] == '#')
+            continue;
+
+        const char *space = line.begin();
+        while (space < line.end() and !isspace(*space))
+            space++;
+
+        Rule rule = {line.end_at(space), line.begin_at(space)};
+        while (!rule.source.empty() and isspace(rule.source[0]))
+            rule.source = rule.source.begin_at(rule.source.begin() + 1);
+
+        if (!is_name(rule.name)) {
+            fmt::error("line %d: '%s' is not a c++ identifier\n", line_no, rule.name);
+            return false;
+        }
+        for (Rule &other : *rules) {
+            if (other.name == rule.name) {
+                fmt::error("line %d: '%s' is already defined\n", line_no, rule.name);
+                return false;
+            }
+        }
+        rules->push(rule);
+    }
+    return true;
+}
+
+FILE *open_output(string prefix, string ext)
+{
+    char path[4096] = {};
+    fmt::write(path, sizeof(path), "%s%s", prefix, ext);
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        fmt::error("cannot write '%s'\n", string{path});
+    return f;
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace regex;
+
+    if (argc != 3) {
+        fmt::error("usage: %s <rules> <output>\n", argv[0]);
+        return 1;
+    }
+
+    Vec<char> text = new_vec<char>(4096);
+    defer(text.deinit());
+    if (!read_file(argv[1], &text)) {
+        fmt::error("cannot read '%s'\n", argv[1]);
+        return 1;
+    }
+
+    Vec<Rule> rules = new_vec<Rule>(16);
+    defer(rules.deinit());
+    if (!parse_rules(string{text.data, text.len}, &rules))
+        return 1;
+
+    Vec<Regex> regexes = new_vec<Regex>(rules.len + 1);
+    defer(for (Regex &regex : regexes) regex.deinit(); regexes.deinit());
+    for (Rule &rule : rules) {
+        Regex &regex = regexes.push(compile_regex(rule.source, Engine_Dfa));
+        if (regex.engine != Engine_Dfa) {
+            fmt::error("'%s' has no dfa, lookaround or too many states\n", rule.name);
+            return 1;
+        }
+    }
+
+    string prefix = argv[2];
+    string base = prefix.begin_at(prefix.begin());
+    for (const char *it = prefix.begin(); it < prefix.end(); it++) {
+        if (*it == '/')
+            base = prefix.begin_at(it + 1);
+    }
+
+    fmt::File_Device header = {};
+    fmt::File_Device source = {};
+    fmt::File_Device graph = {};
+    header.f = open_output(prefix, ".hpp");
+    source.f = open_output(prefix, ".cpp");
+    graph.f = open_output(prefix, ".dot");
+    defer(if (header.f) fclose(header.f));
+    defer(if (source.f) fclose(source.f));
+    defer(if (graph.f) fclose(graph.f));
+    if (!header.f or !source.f or !graph.f)
+        return 1;
+
+    header.format("// generated by bee-regen from %s, do not edit\n", string{argv[1]});
+    header.format("#pragma once\n\n#include \"regex.hpp\"\n\nnamespace bee::regex::gen\n{\n\n");
+    source.format("// generated by bee-regen from %s, do not edit\n", string{argv[1]});
+    source.format("#include \"%s.hpp\"\n\nnamespace bee::regex::gen\n{\n\n", base);
+
+    for (size_t i = 0; i < rules.len; i++) {
+        generate_declaration(&header, rules[i].name);
+        generate_matcher(&source, rules[i].name, &regexes[i]);
+        graph.format("// %s\n%v\n", rules[i].name, regexes[i]);
+    }
+
+    header.format("\n} // namespace bee::regex::gen\n");
+    source.format("} // namespace bee::regex::gen\n");
+    return 0;
+}
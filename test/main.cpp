@@ -17,4 +17,27 @@ int main(int argc, char *argv[])
     regex_wave();
     regex_not();
     regex_dash();
+    regex_dfa();
+    regex_lazy_dfa();
+    regex_pike();
+    regex_memo();
+    regex_prefilter();
+    regex_find();
+    regex_stream();
+    regex_lexer();
+    regex_static();
+    regex_regen();
+    regex_image();
+    regex_intern();
+    regex_parallel();
+    regex_batch();
+    regex_storage();
+    regex_pool();
+    regex_large();
+    regex_until();
+    regex_deep();
+    regex_glushkov();
+    regex_keywords();
+    regex_simplify();
+    regex_shared();
 }
@@ -1,6 +1,14 @@
 #include "regex_test.hpp"
 #include "regex.hpp"
+#include "regex_cache.hpp"
+#include "regex_image.hpp"
+#include "regex_lexer.hpp"
+#include "regex_parallel.hpp"
+#include "regex_rules.hpp"
+#include "regex_static.hpp"
+#include "regex_stream.hpp"
 #include "test.hpp"
+#include <unistd.h>
 
 namespace bee
 {
@@ -21,20 +29,126 @@ using namespace regex;
     iaculis.In eu mi bibendum neque."
 
 const string Lorem_Ipsum = Lorem_Ipsum_;
-const string Lorem_Ipsum_Quoted = "'" Lorem_Ipsum_ "'";
+#define Lorem_Ipsum_Quoted_ "'" Lorem_Ipsum_ "'"
 
-Match regex_match(string source, string expr)
+const string Lorem_Ipsum_Quoted = Lorem_Ipsum_Quoted_;
+
+Match regex_match(string source, string expr, Engine engine = Engine_Backtrack)
 {
-    Regex regex = compile_regex(source);
+    const Regex *regex = regex_cache()->acquire(source, engine);
+    defer(regex_cache()->release(regex));
+
+    return regex->match(expr);
+}
+
+// One way to run a compiled regex, what it finds on 'inputs' goes to 'out'
+typedef bool (*Runner)(const Regex *regex, View<string> inputs, Vec<Match> *out, void *ctx);
+
+bool same_match(const Match &match, const Match &expected)
+{
+    return match.ok == expected.ok and (!match.ok or (match.view.data == expected.view.data and
+                                                       match.view.len == expected.view.len));
+}
+
+bool same_matches(const Vec<Match> &matches, const Vec<Match> &expected)
+{
+    if (matches.len != expected.len)
+        return false;
+    for (size_t i = 0; i < matches.len; i++) {
+        if (!same_match(matches[i], expected[i]))
+            return false;
+    }
+    return true;
+}
+
+// Match and leftmost match of each input
+bool run_match_find(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    for (string input : inputs) {
+        out->push(regex->match(input));
+        out->push(regex->find(input));
+    }
+    return true;
+}
+
+bool run_match(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    for (string input : inputs)
+        out->push(regex->match(input));
+    return true;
+}
+
+bool run_find_all(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    for (string input : inputs) {
+        for (const Match &match : regex->find_all(input))
+            out->push(match);
+    }
+    return true;
+}
+
+// The match of the backtracker and the first one it has tried at every start
+bool run_backtrack(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    const Regex *backtrack = regex_cache()->acquire(regex->source, Engine_Backtrack);
+    defer(regex_cache()->release(backtrack));
+
+    for (string input : inputs) {
+        out->push(backtrack->match(input));
+        Match found = new_match(input, npos);
+        for (u64 n = 0; n <= input.len and !found.ok; n++)
+            found = backtrack->match(input.begin_at(&input.data[n]));
+        out->push(found);
+    }
+    return true;
+}
+
+// Same matches from 'run' as from 'expect' on 'source' compiled with 'config'
+bool regex_runner_match_each(Runner run, Runner expect, Config config, string source, View<string> inputs,
+                             void *ctx = NULL)
+{
+    Regex regex = compile_regex(source, config);
+    Vec<Match> matches = new_vec<Match>(inputs.len * 2);
+    Vec<Match> expected = new_vec<Match>(inputs.len * 2);
     defer(regex.deinit());
+    defer(matches.deinit());
+    defer(expected.deinit());
 
-    return regex.match(expr);
+    if (regex.engine != config.engine or !run(&regex, inputs, &matches, ctx) or
+        !expect(&regex, inputs, &expected, ctx))
+        return false;
+    return same_matches(matches, expected);
+}
+
+bool regex_runner_match(Runner run, Runner expect, Config config, string source, string input,
+                        void *ctx = NULL)
+{
+    return regex_runner_match_each(run, expect, config, source, View<string>{&input, 1}, ctx);
+}
+
+// The same on the Pike VM
+bool run_pike(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    Regex pike = compile_regex(regex->source, Engine_Pike);
+    defer(pike.deinit());
+    return pike.engine == Engine_Pike and run_match_find(&pike, inputs, out, NULL);
+}
+
+bool run_pike_find_all(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    Regex pike = compile_regex(regex->source, Engine_Pike);
+    defer(pike.deinit());
+    return pike.engine == Engine_Pike and run_find_all(&pike, inputs, out, NULL);
 }
 
 #define Match_Ok(source, expr) Expect(regex_match(source, expr).ok)
 #define Match_Npos(source, expr) Expect(!regex_match(source, expr).ok)
 #define Match(source, expr) Expect_Eq(regex_match(source, expr).view, expr)
 #define Match_Eq(source, expr, eq) Expect_Eq(regex_match(source, expr).view, eq)
+#define Match_Engine(engine, source, expr) \
+    Expect(regex_runner_match(run_match_find, run_backtrack, new_config(engine), source, expr))
+#define Match_Program(engine, source, expr) \
+    Expect(regex_runner_match(run_match_find, run_pike, new_config(engine), source, expr))
 
 void regex_string()
 {
@@ -86,6 +200,15 @@ void regex_set()
     Match_Npos("n", "|");
     Match_Npos("Q", "^");
     Match_Npos("q", "&");
+
+    Match("{a|n|'_'}+", "snake_case_42");
+    Match("{[a-c]|'z'}+", "abczcba");
+    Match_Npos("{[a-c]|'z'}", "y");
+
+    Regex regex = compile_regex("{a|n|'_'}");
+    defer(regex.deinit());
+    Expect(regex.node_head->state.option == Regex_Set);
+    Expect(regex.node_head->state.set.count() == 52 + 10 + 1);
 }
 
 void regex_sequence()
@@ -170,4 +293,1215 @@ void regex_dash()
     Match_Eq("^~/_", "words words", "words");
 }
 
+void regex_dfa()
+{
+    Test("dfa");
+
+    Match_Engine(Engine_Dfa, "'abc'", "abc");
+    Match_Engine(Engine_Dfa, "'abc'", "abcccccccccc");
+    Match_Engine(Engine_Dfa, "'cba'", "abc");
+    Match_Engine(Engine_Dfa, Lorem_Ipsum_Quoted, Lorem_Ipsum);
+    Match_Engine(Engine_Dfa, "[a-f]+", "abcedefg");
+    Match_Engine(Engine_Dfa, "[a-z]", "{");
+    Match_Engine(Engine_Dfa, "a n _ o Q q", "a1 +\"'");
+    Match_Engine(Engine_Dfa, "{{{{{{'ab'} {'c'}}}}}}", "abc");
+    Match_Engine(Engine_Dfa, "{'ab'n}+", "ab1ab2ab3");
+    Match_Engine(Engine_Dfa, "{'abc'}*", "");
+    Match_Engine(Engine_Dfa, "{{{'hello'}}}*", "hellohellohello");
+    Match_Engine(Engine_Dfa, "{'ab'n}?", "ab1");
+    Match_Engine(Engine_Dfa, "a{a|'_'|n}*", "snake_case_variable123");
+    Match_Engine(Engine_Dfa, "^~'c'", "abcabc");
+    Match_Engine(Engine_Dfa, "'//' {a|' '} ~ '//'", "// The program starts here // int main() {");
+    Match_Engine(Engine_Dfa, "n ~ {'z'|'9'}", "012345678z");
+    Match_Engine(Engine_Dfa, "{' '} ~ 'sus'", "                           sus               ");
+    Match_Engine(Engine_Dfa, "{' '} ~ 'sus'", "            |             sus               ");
+}
+
+void regex_lazy_dfa()
+{
+    Test("lazy dfa");
+
+    Match_Engine(Engine_Lazy_Dfa, "'abc'", "abcccccccccc");
+    Match_Engine(Engine_Lazy_Dfa, "'cba'", "abc");
+    Match_Engine(Engine_Lazy_Dfa, Lorem_Ipsum_Quoted, Lorem_Ipsum);
+    Match_Engine(Engine_Lazy_Dfa, "{'abc'}*", "");
+    Match_Engine(Engine_Lazy_Dfa, "{'ab'n}+", "ab1ab2ab3");
+    Match_Engine(Engine_Lazy_Dfa, "a{a|'_'|n}*", "snake_case_variable123");
+    Match_Engine(Engine_Lazy_Dfa, "'//' {a|' '} ~ '//'", "// The program starts here // int main() {");
+    Match_Engine(Engine_Lazy_Dfa, "{a|n} ~ 'end'", "abc123end");
+    Match_Engine(Engine_Lazy_Dfa, "{' '} ~ 'sus'", "            |             sus               ");
+
+    Config config = new_config(Engine_Lazy_Dfa);
+    config.cache_size = 0;
+    Regex small = compile_regex(Lorem_Ipsum_Quoted, config);
+    config.cache_size = 4 << 20;
+    Regex large = compile_regex(Lorem_Ipsum_Quoted, config);
+    defer(small.deinit());
+    defer(large.deinit());
+
+    // the states are kept by the scratch
+    Scratch small_scratch = new_scratch(&small);
+    Scratch large_scratch = new_scratch(&large);
+    defer(small_scratch.deinit(); large_scratch.deinit());
+
+    Expect_Eq(small.match(Lorem_Ipsum, &small_scratch).view, Lorem_Ipsum);
+    Lazy_Dfa_Stats stats = small_scratch.lazy_dfa.stats();
+    Expect(stats.flushes > 0 and stats.misses == Lorem_Ipsum.len);
+
+    Expect_Eq(large.match(Lorem_Ipsum, &large_scratch).view, Lorem_Ipsum);
+    Expect_Eq(large.match(Lorem_Ipsum, &large_scratch).view, Lorem_Ipsum);
+    stats = large_scratch.lazy_dfa.stats();
+    Expect(stats.flushes == 0 and stats.misses == Lorem_Ipsum.len and stats.hits == Lorem_Ipsum.len);
+
+    // a thread going back and forth between the regexes keeps both scratches
+    Expect_Eq(large.match(Lorem_Ipsum).view, Lorem_Ipsum);
+    Expect_Eq(small.match(Lorem_Ipsum).view, Lorem_Ipsum);
+    Expect_Eq(large.match(Lorem_Ipsum).view, Lorem_Ipsum);
+    stats = thread_scratch(&large)->lazy_dfa.stats();
+    Expect(stats.flushes == 0 and stats.misses == Lorem_Ipsum.len and stats.hits == Lorem_Ipsum.len);
+}
+
+void regex_pike()
+{
+    Test("pike");
+
+    Match_Engine(Engine_Pike, "'abc'", "abcccccccccc");
+    Match_Engine(Engine_Pike, "'cba'", "abc");
+    Match_Engine(Engine_Pike, Lorem_Ipsum_Quoted, Lorem_Ipsum);
+    Match_Engine(Engine_Pike, "[[-]]+", "[\\\\\\\\\\]");
+    Match_Engine(Engine_Pike, "{'abc'}*", "");
+    Match_Engine(Engine_Pike, "{'ab'n}+", "ab1ab2ab3");
+    Match_Engine(Engine_Pike, "{{{'hello'}}}?", "hello");
+    Match_Engine(Engine_Pike, "a{a|'_'|n}*", "snake_case_variable123");
+    Match_Engine(Engine_Pike, "'//' {a|' '} ~ '//'", "// The program starts here // int main() {");
+    Match_Engine(Engine_Pike, "{' '} ~ 'sus'", "            |             sus               ");
+    Match_Engine(Engine_Pike, "'abc' !'d'", "abcd");
+    Match_Engine(Engine_Pike, "'abc' !'d'", "abc_");
+    Match_Engine(Engine_Pike, "{!'\n'}*", "lorem ipsum\n hello");
+    Match_Engine(Engine_Pike, "'abc'/'d'", "abcd");
+    Match_Engine(Engine_Pike, "^~/_", "words words");
+
+    // exponential for the backtracker
+    Expect(!regex_match("{n|n}* 'x'", "0123456789012345678901234567890123456789", Engine_Pike).ok);
+    Expect_Eq(regex_match("{a|n}* ~ 'end'", "abc123end", Engine_Pike).view, "abc123end");
+}
+
+void regex_memo()
+{
+    Test("memo");
+
+    const string digits = "0123456789012345678901234567890123456789";
+    Expect(!regex_match("{n|n}* 'x'", digits).ok);
+    Expect_Eq(regex_match("{n|n}* n", digits).view, digits);
+    Expect(!regex_match("{!'x'|n}* 'x'", digits).ok);
+    Expect_Eq(regex_match("{!'x'|n}+ /'9'", digits).view, digits.substr(0, digits.len - 1));
+
+    Config config = new_config();
+    config.memo_size = 0;
+    Regex regex = compile_regex("'abc' !'d' {n|n}*", config);
+    defer(regex.deinit());
+
+    Expect_Eq(regex.match("abc_1234").view, regex_match("'abc' !'d' {n|n}*", "abc_1234").view);
+    Expect_Eq(regex.match("abcd1234").ok, regex_match("'abc' !'d' {n|n}*", "abcd1234").ok);
+}
+
+Match regex_find(string source, string haystack)
+{
+    Regex regex = compile_regex(source);
+    defer(regex.deinit());
+
+    return regex.find(haystack);
+}
+
+#define Find_Eq(source, haystack, eq) Expect_Eq(regex_find(source, haystack).view, eq)
+#define Find_Npos(source, haystack) Expect(!regex_find(source, haystack).ok)
+
+void regex_prefilter()
+{
+    Test("prefilter");
+
+    Regex regex = compile_regex("{' '} ~ 'sus'");
+    defer(regex.deinit());
+    Expect(regex.prefilter.literal == "sus" and regex.prefilter.min == 0);
+    Expect(regex.prefilter.max == Prefilter_Unbounded);
+
+    Regex fixed = compile_regex("n {'ab'|'cd'} 'xyz' !'w'");
+    defer(fixed.deinit());
+    Expect(fixed.prefilter.literal == "xyz" and fixed.prefilter.min == 3 and fixed.prefilter.max == 3);
+
+    Regex none = compile_regex("{'abc'}* n");
+    defer(none.deinit());
+    Expect(none.prefilter.empty());
+
+    Find_Eq("'sus'", Lorem_Ipsum, "sus");
+    Find_Eq("{' '} ~ 'sus'", "among us  sus", "  sus");
+    Find_Eq("n {'ab'|'cd'} 'xyz' !'w'", "1abxyzw 2cdxyz_ 3abxyz", "2cdxyz_");
+    Find_Eq("'//' {a|' '} ~ '//'", "int main() { // The program starts here // }", "// The program starts here //");
+    Find_Eq("{'abc'}* n", "abcab abc7", "abc7");
+    Find_Npos("'sus' n", Lorem_Ipsum);
+    Find_Npos("n 'xyz'", "xyz axyz");
+}
+
+u64 regex_count(string source, string haystack, Engine engine)
+{
+    Regex regex = compile_regex(source, engine);
+    defer(regex.deinit());
+
+    u64 count = 0;
+    for (const Match &match : regex.find_all(haystack)) {
+        Expect(match.ok and match.view.end() <= haystack.end());
+        count++;
+    }
+    return count;
+}
+
+void regex_find()
+{
+    Test("find");
+
+    const Engine engines[] = {Engine_Backtrack, Engine_Dfa, Engine_Lazy_Dfa, Engine_Pike};
+    for (Engine engine : engines) {
+        Match_Engine(engine, "'sus'", Lorem_Ipsum);
+        Match_Engine(engine, "'sus' n", Lorem_Ipsum);
+        Match_Engine(engine, "{'abc'}* n", "abcab abc7");
+        Match_Engine(engine, "{'abc'}*", "xyz");
+        Match_Engine(engine, "'abcd' | 'c'", "abcd");
+        Match_Engine(engine, "'bcd' | 'abcx'", "abcd");
+        Match_Engine(engine, "a+ n", "words and more words7 ");
+        Match_Engine(engine, "{' '} ~ 'sus'", "among us  sus");
+        Match_Engine(engine, "'//' {a|' '} ~ '//'", "int main() { // The program starts here // }");
+        Match_Engine(engine, "n {'ab'|'cd'} 'xyz'", "1abxy 2cdxyz_ 3abxyz");
+        Match_Engine(engine, "[a-f]+", "");
+        Match_Engine(engine, "Q q", "a1 +\"'");
+        Match_Engine(engine, "''", "abc");
+        Match_Engine(engine, "a ''", "1 ab");
+        Match_Engine(engine, "'' 'b' ''", "abc");
+        Match_Engine(engine, "{'' | 'b'} 'c'", "abc");
+    }
+    Match_Engine(Engine_Pike, "n {'ab'|'cd'} 'xyz' !'w'", "1abxyzw 2cdxyz_ 3abxyz");
+    Match_Engine(Engine_Pike, "a+ /n", "words and more words7 ");
+    Match_Engine(Engine_Backtrack, "n {'ab'|'cd'} 'xyz' !'w'", "1abxyzw 2cdxyz_ 3abxyz");
+    Match_Engine(Engine_Backtrack, "{'ab'}* 'c' | 'b'", "ababx abababc");
+    Match_Engine(Engine_Backtrack, "{_|'x'}* ~ 'end'", "x x en x end");
+    Match_Engine(Engine_Backtrack, "a ''", "1 a");
+
+    // '' matches at the end of the input on the program, the backtracker fails there
+    Regex empty = compile_regex("'' 'b' ''", Engine_Pike);
+    defer(empty.deinit());
+    string haystack = "1 ab";
+    Expect(empty.find(haystack).ok and empty.find(haystack).view.data == &haystack.data[3]);
+    const Engine programs[] = {Engine_Dfa, Engine_Lazy_Dfa};
+    for (Engine engine : programs) {
+        Match_Program(engine, "''", "");
+        Match_Program(engine, "''", "abc");
+        Match_Program(engine, "'' 'b' ''", "1 ab");
+        Match_Program(engine, "a ''", "1 a");
+        Match_Program(engine, "{'' | 'b'} ''", "b");
+    }
+
+    const Engine all[] = {Engine_Backtrack, Engine_Dfa, Engine_Lazy_Dfa, Engine_Pike};
+    for (Engine engine : all) {
+        Expect_Eq(regex_count("'sus'", Lorem_Ipsum, engine), 5);
+        Expect_Eq(regex_count("'in'", Lorem_Ipsum, engine), 13);
+        Expect_Eq(regex_count("a+", "ab cd  ef", engine), 3);
+        Expect_Eq(regex_count("n*", "ab12", engine), 4);
+        Expect_Eq(regex_count("'xyz'", "", engine), 0);
+    }
+
+    // the start of every Dfa match is found in the same lists
+    Regex dfa = compile_regex("a+ n", Engine_Dfa);
+    Scratch scratch = new_scratch(&dfa);
+    defer(dfa.deinit(); scratch.deinit());
+    Expect(dfa.find("words and more words7 ", &scratch).view == "words7");
+    u32 *dense = scratch.reverse.set.dense;
+    for (const Match &match : dfa.find_all("ab1 cd2 ef3", &scratch))
+        Expect(match.view.len == 3);
+    Expect(dense != NULL and scratch.reverse.set.dense == dense);
+}
+
+struct Stream_Run
+{
+    size_t window;
+    u64 truncated;
+    bool rejected;
+};
+
+// The matches of a stream fed one byte at a time, every other chunk size
+// must settle the same ones. Without a Stream_Run none may be truncated.
+bool run_stream(const Regex *regex, View<string> inputs, Vec<Match> *out, void *ctx)
+{
+    Stream_Run whole = {Stream_Window, 0, false};
+    auto run = ctx != NULL ? (Stream_Run *)ctx : &whole;
+    Stream stream = {};
+    Vec<Stream_Match> first = new_vec<Stream_Match>(16);
+    Vec<Stream_Match> matches = new_vec<Stream_Match>(16);
+    defer(stream.deinit());
+    defer(first.deinit());
+    defer(matches.deinit());
+    if (!compile_stream(regex, &stream, run->window)) {
+        run->rejected = true;
+        return false;
+    }
+
+    for (string input : inputs) {
+        for (size_t chunk = 1; chunk <= input.len + 1; chunk++) {
+            matches.len = 0;
+            for (size_t i = 0; i < input.len; i += chunk)
+                stream.submit(input.substr(i, Min(chunk, input.len - i)), &matches);
+            stream.finish(&matches);
+
+            if (chunk == 1) {
+                first.len = 0;
+                first.concat(matches.begin(), matches.end());
+                continue;
+            }
+            if (matches.len != first.len)
+                return false;
+            for (size_t i = 0; i < matches.len; i++) {
+                if (matches[i].begin != first[i].begin or matches[i].end != first[i].end or
+                    matches[i].truncated != first[i].truncated)
+                    return false;
+            }
+        }
+        for (const Stream_Match &match : first) {
+            run->truncated += match.truncated;
+            out->push(Match{true, string{input.data + match.begin, match.end - match.begin}, {}});
+        }
+    }
+    return ctx != NULL or whole.truncated == 0;
+}
+
+#define Match_Stream(source, haystack) \
+    Expect(regex_runner_match(run_stream, run_find_all, new_config(), source, haystack))
+
+void regex_stream()
+{
+    Test("stream");
+
+    Match_Stream("'sus'", Lorem_Ipsum);
+    Match_Stream("a+", "ab cd  ef");
+    Match_Stream("n*", "ab12");
+    Match_Stream("'xyz'", "");
+    Match_Stream("{'abc'}* n", "abcab abc7");
+    Match_Stream("'abcd' | 'c'", "abcabcd");
+    Match_Stream("{'a' ^* 'z'} | 'a'", "aaaaaaaz aaa");
+    Match_Stream("{' '} ~ 'sus'", "among us  sus sus");
+    Match_Stream("'//' {a|' '} ~ '//'", "int main() { // The program starts here // } //");
+    Match_Stream("'' 'b'", "abb");
+
+    // the stream runs the program, where '' matches at the end of the input too
+    Expect(regex_runner_match(run_stream, run_pike_find_all, new_config(), "''", "ab"));
+    Expect(regex_runner_match(run_stream, run_pike_find_all, new_config(), "'b' ''", "abb"));
+
+    // a window shorter than the matches that fail still settles those of find_all
+    Stream_Run small = {4, 0, false};
+    Expect(regex_runner_match(run_stream, run_find_all, new_config(), "{'a' ^* 'z'} | 'a'", "a0b1a2345678",
+                              &small));
+    Expect(small.truncated == 2);
+    Stream_Run refused = {Stream_Window, 0, false};
+    Expect(!regex_runner_match(run_stream, run_find_all, new_config(), "a+ /n", "ab1", &refused));
+    Expect(refused.rejected);
+
+    // the window bounds the bytes kept after a match
+    Regex regex = compile_regex("{'a' ^* 'z'} | 'a'");
+    Stream stream = {};
+    Vec<Stream_Match> matches = new_vec<Stream_Match>(4);
+    defer(regex.deinit());
+    defer(stream.deinit());
+    defer(matches.deinit());
+    Expect(compile_stream(&regex, &stream, 4));
+
+    stream.submit("xa0123456789", &matches);
+    Expect(matches.len == 1 and matches[0].begin == 1 and matches[0].end == 2 and matches[0].truncated);
+    stream.submit("az", &matches);
+    stream.finish(&matches);
+    Expect(matches.len == 2 and matches[1].begin == 12 and matches[1].end == 14 and !matches[1].truncated);
+    Expect(stream.replay.cap <= 64);
+
+    // the bytes kept past a truncated match are searched again, a 'z' after
+    // the window makes find_all report a longer first match
+    matches.len = 0;
+    stream.submit("a0b1a2345678", &matches);
+    stream.finish(&matches);
+    Expect(matches.len == 2 and matches[0].begin == 0 and matches[0].end == 1 and matches[0].truncated);
+    Expect(matches[1].begin == 4 and matches[1].end == 5 and matches[1].truncated);
+    Expect(regex.find("a0b1a2345678z").view.len == 13);
+
+    // the input is only read forward
+    Regex lookaround = compile_regex("a+ !n");
+    Stream rejected = {};
+    defer(lookaround.deinit());
+    Expect(!compile_stream(&lookaround, &rejected) and rejected.prog.insts.data == NULL);
+}
+
+enum Token_Kind
+{
+    Token_If,
+    Token_Else,
+    Token_Identifier,
+    Token_Number,
+    Token_Space,
+    Token_Equal,
+    Token_Assign,
+    Token_Comment,
+};
+
+// Kinds of the tokens of 'expr', npos stops the list when the lexer is stuck
+bool regex_lex(View<Lexer_Rule> rules, string expr, View<u32> kinds)
+{
+    Lexer lexer = compile_lexer(rules);
+    Lexer_Scratch scratch = new_lexer_scratch(&lexer);
+    defer(lexer.deinit(); scratch.deinit());
+
+    string rest = expr;
+    for (u32 kind : kinds) {
+        Token token = lexer.next(rest, &scratch);
+        if (kind == (u32)npos)
+            return !token.ok;
+        if (!token.ok or token.kind != kind)
+            return false;
+        rest = token.next;
+    }
+    return rest.len == 0;
+}
+
+struct Lex_Job
+{
+    const Lexer *lexer;
+    string expr;
+    View<u32> kinds;
+    bool *same;
+};
+
+void lex_shared(void *data, u32 index)
+{
+    auto job = (Lex_Job *)data;
+    Lexer_Scratch scratch = new_lexer_scratch(job->lexer);
+    defer(scratch.deinit());
+
+    bool same = true;
+    for (u32 round = 0; round < 16; round++) {
+        string rest = job->expr;
+        for (u32 kind : job->kinds) {
+            Token token = job->lexer->next(rest, &scratch);
+            same = same and token.ok and token.kind == kind;
+            rest = token.next;
+        }
+        same = same and rest.len == 0;
+    }
+    job->same[index] = same;
+}
+
+bool regex_lex_shared(Thread_Pool *pool, View<Lexer_Rule> rules, string expr, View<u32> kinds)
+{
+    Lexer lexer = compile_lexer(rules);
+    defer(lexer.deinit());
+
+    bool same[8] = {};
+    Lex_Job job = {&lexer, expr, kinds, same};
+    pool->run(8, lex_shared, &job);
+    for (bool it : same) {
+        if (!it)
+            return false;
+    }
+    return true;
+}
+
+void regex_lexer()
+{
+    Test("lexer");
+
+    Lexer_Rule rules[] = {
+        {Token_If, "'if'"},
+        {Token_Else, "'else'"},
+        {Token_Identifier, "a{a|n|'_'}*"},
+        {Token_Number, "n+"},
+        {Token_Space, "{' '|'\n'}+"},
+        {Token_Equal, "'=='"},
+        {Token_Assign, "'='"},
+        {Token_Comment, "'//' ^ ~ '\n'"},
+    };
+    View<Lexer_Rule> view = {rules, sizeof(rules) / sizeof(rules[0])};
+
+    u32 kinds[] = {Token_If, Token_Space, Token_Identifier, Token_Equal, Token_Number, Token_Space, Token_Comment,
+                   Token_Else, Token_Space, Token_Identifier, Token_Assign, Token_Identifier};
+    Expect(regex_lex(view, "if iffy==12 // if\nelse x_1=elsewhere", {kinds, sizeof(kinds) / sizeof(kinds[0])}));
+
+    u32 stuck[] = {Token_Identifier, Token_Space, (u32)npos};
+    Expect(regex_lex(view, "abc ;", {stuck, 3}));
+
+    Lexer lexer = compile_lexer(view);
+    Lexer_Scratch scratch = new_lexer_scratch(&lexer);
+    defer(lexer.deinit(); scratch.deinit());
+    Expect(lexer.regexes.empty());
+    Token token = lexer.next("// comment\n// other\n", &scratch);
+    Expect(token.ok and token.kind == Token_Comment and token.view == "// comment\n");
+
+    // the rules with lookaround are tried one by one
+    Lexer_Rule lookaround[] = {
+        {Token_Number, "n+ /' '"},
+        {Token_Identifier, "a+"},
+        {Token_Space, "' '"},
+    };
+    Lexer fallback = compile_lexer({lookaround, 3});
+    defer(fallback.deinit());
+    Expect(!fallback.regexes.empty());
+
+    u32 words[] = {Token_Identifier, Token_Space, Token_Number, Token_Space, (u32)npos};
+    Expect(regex_lex({lookaround, 3}, "abc 123 456", {words, 5}));
+
+    Lexer empty = compile_lexer({});
+    Lexer_Scratch empty_scratch = new_lexer_scratch(&empty);
+    defer(empty.deinit(); empty_scratch.deinit());
+    Expect(!empty.next("abc", &empty_scratch).ok);
+
+    // the threads of a pool share one lexer, each with its own scratch
+    Thread_Pool *pool = new_thread_pool(4);
+    defer(pool->deinit());
+    Expect(regex_lex_shared(pool, view, "if iffy==12 // if\nelse x_1=elsewhere", {kinds, 12}));
+    Expect(regex_lex_shared(pool, {lookaround, 3}, "abc 123 ", {words, 4}));
+}
+
+// Same match as the runtime regex
+template <Regex_Literal Source>
+bool regex_static_match(string expr)
+{
+    constexpr auto regex = compile_static_regex<Source>();
+    Match match = regex.match(expr);
+    Match expected = regex_match(Source.data, expr);
+    return match.ok == expected.ok and match.view == expected.view and match.next == expected.next;
+}
+
+#define Match_Static(source, expr) Expect(regex_static_match<source>(expr))
+
+void regex_static()
+{
+    Test("static");
+
+    static_assert(Static_Regex<"'abc' n">::pattern.len == 2);
+    static_assert(Static_Regex<"{'_'|a|[0-9]} a">::pattern.len == 2);
+    static_assert(Static_Regex<"{{'ab'} {}} ^">::pattern.len == 2);
+
+    Match_Static("'abc'", "abcccccccccc");
+    Match_Static("'cba'", "abc");
+    Match_Static("'abc'", "ab");
+    Match_Static("'0x' n n", "0x42");
+    Match_Static("'0x' n n", "0x4g");
+    Match_Static("{'_'|a|[0-9]} a", "_z");
+    Match_Static("{'_'|a|[0-9]} a", "-z");
+    Match_Static("a | n | '_'", "7");
+    Match_Static("[a-f] ^ `x`", "f\nx");
+    Match_Static("q Q o _", "'\"+ ");
+    Match_Static("{{'ab'} {}} ^", "ab");
+    Match_Static("{{'ab'} {}} ^", "abc");
+    Match_Static("''", "");
+    Match_Static("", "abc");
+    Match_Static(Lorem_Ipsum_Quoted_, Lorem_Ipsum);
+}
+
+// Same match as the runtime regex and as its minimized Dfa
+typedef Match Generated_Match(string expr);
+
+bool regex_regen_match(Generated_Match *generated, string source, string expr)
+{
+    Regex regex = compile_regex(source, Engine_Dfa);
+    defer(regex.deinit());
+    Dfa dfa = minimize_dfa(&regex.dfa);
+    defer(dfa.deinit());
+
+    Match match = generated(expr);
+    Match expected = regex_match(source, expr);
+    return dfa.len <= regex.dfa.len and new_match(expr, dfa.submit(expr)).view == expected.view and
+           match.ok == expected.ok and match.view == expected.view and match.next == expected.next;
+}
+
+#define Match_Regen(name, source, expr) Expect(regex_regen_match(gen::match_##name, source, expr))
+
+void regex_regen()
+{
+    Test("regen");
+
+    Match_Regen(ident, "{a|'_'} {a|n|'_'}*", "snake_case_variable123 = 0");
+    Match_Regen(ident, "{a|'_'} {a|n|'_'}*", "123abc");
+    Match_Regen(number, "n+ {'.' n+}?", "3.1415;");
+    Match_Regen(number, "n+ {'.' n+}?", "42.");
+    Match_Regen(hex, "'0x' {n|[a-f]|[A-F]}+", "0xdeadBEEFg");
+    Match_Regen(hex, "'0x' {n|[a-f]|[A-F]}+", "0x");
+    Match_Regen(string, "Q ^~Q", "\"abc\" \"def\"");
+    Match_Regen(string, "Q ^~Q", "\"abc");
+    Match_Regen(comment, "'/*' ^~'*/'", "/* a * b / c */ d */");
+    Match_Regen(keyword, "{'if' | 'else' | 'while'}", "elsewhere");
+    Match_Regen(keyword, "{'if' | 'else' | 'while'}", "whale");
+    Match_Regen(spaces, "_+", " \t \v x");
+    Match_Regen(empty, "", "abc");
+    Match_Regen(ident, "{a|'_'} {a|n|'_'}*", Lorem_Ipsum);
+}
+
+// Match and leftmost match of every suffix of each input
+bool run_suffixes(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    for (string input : inputs) {
+        for (size_t i = 0; i <= input.len; i++) {
+            string expr = input.begin_at(&input.data[i]);
+            run_match_find(regex, View<string>{&expr, 1}, out, NULL);
+        }
+    }
+    return true;
+}
+
+// The same on the image encoded from the regex
+bool run_image(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    Vec<char> buf = new_vec<char>(1024);
+    Regex_Image image = {};
+    defer(buf.deinit());
+
+    if (!encode_regex_image(regex, &buf) or !view_regex_image(string{buf.data, buf.len}, &image))
+        return false;
+    if (image.source != regex->source)
+        return false;
+
+    for (string input : inputs) {
+        for (size_t i = 0; i <= input.len; i++) {
+            string expr = input.begin_at(&input.data[i]);
+            out->push(image.match(expr));
+            out->push(image.find(expr));
+        }
+    }
+    return true;
+}
+
+#define Match_Image(source, haystack) \
+    Expect(regex_runner_match(run_image, run_suffixes, new_config(), source, haystack))
+
+void regex_image()
+{
+    Test("image");
+
+    Match_Image("'abc'", "xxabcabc");
+    Match_Image("a{a|n|'_'}*", "123 snake_case_variable123 = 0");
+    Match_Image("n+ {'.' n+}?", "pi = 3.1415;");
+    Match_Image("{'abc'}* n", "abcab abc7");
+    Match_Image("'abcd' | 'c'", "abcabcd");
+    Match_Image("{'a' ^* 'z'} | 'a'", "aaaaaaaz aaa");
+    Match_Image("'//' {a|' '} ~ '//'", "int main() { // The program starts here // } //");
+    Match_Image("n*", "ab12");
+    Match_Image("", "abc");
+    Match_Image("'sus'", Lorem_Ipsum);
+    Match_Image("a+ n", "words and more words7 ");
+    Match_Image("{a|' '}* 'x' | a", "abc abc");
+
+    // lookaround has no Dfa
+    Regex dash = compile_regex("'abc'/'d'");
+    Vec<char> buf = new_vec<char>(1024);
+    defer(dash.deinit());
+    defer(buf.deinit());
+    Expect(!encode_regex_image(&dash, &buf));
+
+    // mapped from a file, a damaged image is rejected
+    Regex regex = compile_regex("a{a|n|'_'}*", Engine_Dfa);
+    defer(regex.deinit());
+    char path[] = "/tmp/bee-image-XXXXXX";
+    int fd = mkstemp(path);
+    Expect(fd >= 0);
+    close(fd);
+    defer(unlink(path));
+
+    Regex_Image image = {};
+    Expect(write_regex_image(&regex, path));
+    Expect(open_regex_image(path, &image));
+    Expect(image.mapped != 0 and image.match("snake_case = 0").view == "snake_case");
+    image.deinit();
+
+    Expect(encode_regex_image(&regex, &buf));
+    Expect(view_regex_image(string{buf.data, buf.len}, &image));
+    Expect(!view_regex_image(string{buf.data, buf.len - 1}, &image));
+    ((Image_Header *)buf.data)->start = (u32)-2;
+    Expect(!view_regex_image(string{buf.data, buf.len}, &image));
+    ((Image_Header *)buf.data)->version++;
+    Expect(!view_regex_image(string{buf.data, buf.len}, &image));
+}
+
+void regex_cache_job(void *data, u32 index)
+{
+    auto cache = (Regex_Cache *)data;
+    char source[8] = {};
+    fmt::write(source, sizeof(source), "'%d'", index % 6);
+
+    const Regex *regex = cache->acquire(source);
+    Expect(regex->match(string{source + 1, strlen(source) - 2}).ok);
+    cache->release(regex);
+}
+
+void regex_intern()
+{
+    Test("cache");
+
+    Regex_Cache cache = new_regex_cache(2);
+    defer(cache.deinit());
+
+    const Regex *a = cache.acquire("'abc'");
+    Expect(cache.acquire("'abc'") == a);
+    const Regex *d = cache.acquire("'abc'", Engine_Dfa);
+    Expect(d != a);
+    Expect(cache.stats.hits == 1 and cache.stats.misses == 2 and cache.stats.len == 2);
+    Expect(a->match("abcd").view == "abc");
+
+    // held regexes are not evicted, the cache grows past its cap
+    const Regex *b = cache.acquire("n+");
+    Expect(cache.stats.len == 3 and cache.stats.evictions == 0);
+    cache.release(b);
+    Expect(cache.stats.len == 2 and cache.stats.evictions == 1);
+
+    // the least recently used regex nobody holds goes first
+    cache.release(a);
+    cache.release(a);
+    cache.release(d);
+    cache.release(cache.acquire("'abc'", Engine_Dfa));
+    cache.release(cache.acquire("'abc'"));
+    cache.release(cache.acquire("a+"));
+    Expect(cache.stats.len == 2 and cache.stats.evictions == 2);
+    u64 misses = cache.stats.misses;
+    cache.release(cache.acquire("'abc'"));
+    Expect(cache.stats.misses == misses);
+    cache.release(cache.acquire("'abc'", Engine_Dfa));
+    Expect(cache.stats.misses == misses + 1);
+
+    // every key is found again after the slots are shuffled by evictions
+    Regex_Cache many = new_regex_cache(8);
+    defer(many.deinit());
+    char sources[32][8] = {};
+    for (u32 i = 0; i < 32; i++) {
+        fmt::write(sources[i], sizeof(sources[i]), "'%d'", i);
+        many.release(many.acquire(sources[i]));
+    }
+    misses = many.stats.misses;
+    for (u32 i = 24; i < 32; i++) {
+        const Regex *regex = many.acquire(sources[i]);
+        Expect(regex->match(string{sources[i] + 1, strlen(sources[i]) - 2}).ok);
+        many.release(regex);
+    }
+    Expect(many.stats.misses == misses and many.stats.len == 8);
+
+    // the threads of a pool share one cache, a held regex outlives the
+    // evictions made by the others
+    Regex_Cache shared = new_regex_cache(2);
+    defer(shared.deinit());
+    Thread_Pool *pool = new_thread_pool(4);
+    defer(pool->deinit());
+    pool->run(1024, regex_cache_job, &shared);
+    Expect(shared.stats.hits + shared.stats.misses == 1024 and shared.stats.len <= 2);
+}
+
+// Match and leftmost match of each input split across the pool in 'ctx'
+bool run_parallel(const Regex *regex, View<string> inputs, Vec<Match> *out, void *ctx)
+{
+    auto pool = (Thread_Pool *)ctx;
+    for (string input : inputs) {
+        out->push(match_parallel(regex, input, pool));
+        out->push(find_parallel(regex, input, pool));
+    }
+    return true;
+}
+
+#define Match_Parallel(source, expr) \
+    Expect(regex_runner_match(run_parallel, run_match_find, new_config(Engine_Dfa), source, expr, pool))
+
+void regex_parallel()
+{
+    Test("parallel");
+
+    Thread_Pool *pool = new_thread_pool(4);
+    defer(pool->deinit());
+
+    // long enough for a chunk per thread
+    Vec<char> buf = new_vec<char>(Parallel_Chunk_Min * 8);
+    while (buf.len < Parallel_Chunk_Min * 6)
+        buf.concat(Lorem_Ipsum.begin(), Lorem_Ipsum.end());
+    string text = {buf.data, buf.len};
+    defer(buf.deinit());
+
+    Match_Parallel("^*", text);
+    Match_Parallel("{a|_|o}*", text);
+    Match_Parallel("{a|_|o}* 'sus'", text);
+    Match_Parallel("^* 'neque.'", text);
+    Match_Parallel("^* 'dolor' ^ ^", text);
+    Match_Parallel("'iaculis.In'", text);
+    Match_Parallel("'pellentesque' ^~'a'", text);
+    Match_Parallel("'sus'", text);
+    Match_Parallel("{a+ ' '}+ 'neque.'", text);
+}
+
+// Matches of one batch on the caller, the batch on the pool in 'ctx' must
+// find the same
+bool run_batch(const Regex *regex, View<string> inputs, Vec<Match> *out, void *ctx)
+{
+    Vec<Match> matches = new_vec<Match>(inputs.len);
+    Vec<Match> pooled = new_vec<Match>(inputs.len);
+    matches.len = pooled.len = inputs.len;
+    defer(matches.deinit());
+    defer(pooled.deinit());
+
+    regex->match_batch(inputs, View<Match>{matches.data, matches.len});
+    regex->match_batch(inputs, View<Match>{pooled.data, pooled.len}, (Thread_Pool *)ctx);
+    out->concat(matches.begin(), matches.end());
+    return same_matches(pooled, matches);
+}
+
+#define Match_Batch(engine, source, inputs) \
+    Expect(regex_runner_match_each(run_batch, run_match, new_config(engine), source, inputs, pool))
+
+void regex_batch()
+{
+    Test("batch");
+
+    Thread_Pool *pool = new_thread_pool(4);
+    defer(pool->deinit());
+
+    // enough inputs for a slice per thread
+    Vec<string> inputs = new_vec<string>(4096);
+    defer(inputs.deinit());
+    for (size_t i = 0; inputs.len < 4096; i = (i + 1) % Lorem_Ipsum.len)
+        inputs.push(Lorem_Ipsum.substr(i, Min(Lorem_Ipsum.len - i, (size_t)24)));
+    View<string> view = {inputs.data, inputs.len};
+
+    Engine engines[] = {Engine_Backtrack, Engine_Dfa, Engine_Lazy_Dfa, Engine_Pike};
+    for (Engine engine : engines) {
+        Match_Batch(engine, "a+", view);
+        Match_Batch(engine, "a{a|n|'_'}* _ a", view);
+        Match_Batch(engine, "^~{'um' | 'em'}", view);
+        Match_Batch(engine, "", view);
+    }
+    Match_Batch(Engine_Pike, "a+ / _", view);
+}
+
+void regex_storage()
+{
+    Test("storage");
+
+    // the nodes are kept in one block of the exact size
+    Regex a = compile_regex("'a'");
+    defer(a.deinit());
+    Expect(a.arena.len == 1 and a.arena.cap == 1);
+
+    // past the 128 nodes of the old inline arena
+    char source[2048] = {};
+    char expr[256] = {};
+    fmt::Write_Status ws = fmt::new_write_status(source, sizeof(source));
+    for (u32 i = 0; i < 200; i++) {
+        ws = fmt::append(ws, "{n|'%c'} ", (char)('a' + i % 26));
+        expr[i] = 'a' + i % 26;
+    }
+    Regex regex = compile_regex(source);
+    defer(regex.deinit());
+    Expect(regex.arena.len >= 200 and regex.arena.cap == regex.arena.len);
+    Expect(regex.match(expr).view == expr);
+    expr[199] = '!';
+    Expect(!regex.match(expr).ok);
+
+    // a regex owns no pointer to itself, it can be moved
+    Regex moved = {};
+    memcpy((void *)&moved, (void *)&regex, sizeof(Regex));
+    memset((void *)&regex, 0, sizeof(Regex));
+    expr[199] = '7';
+    Expect(moved.match(expr).view == expr);
+    memcpy((void *)&regex, (void *)&moved, sizeof(Regex));
+}
+
+void regex_pool()
+{
+    Test("pool");
+
+    Node_Set_Pool pool = new_pool<Node_Set>(4);
+    defer(pool.deinit());
+    Node_Set *a = pool.alloc(Node_Set{NULL, NULL});
+    Node_Set *b = pool.alloc(Node_Set{NULL, a});
+    Expect(pool.live() == 2 and b->next == a);
+
+    // released cells are reused before the pool grows
+    pool.release(a);
+    Expect(pool.alloc(Node_Set{NULL, b}) == a and pool.live() == 2);
+
+    for (u32 i = 0; i < 100; i++)
+        pool.alloc(Node_Set{NULL, NULL});
+    Expect(pool.live() == 102 and pool.cells.blocks.len == 5);
+
+    // one bucket chains every key, the head leaves the table before its
+    // cell is handed out again
+    Hash_Map<u64, u32> hash_map = new_hash_map<u64, u32>(1);
+    defer(hash_map.deinit());
+    hash_map.insert(1, 10);
+    hash_map.insert(2, 20);
+    Expect(hash_map.extract(1).value == 10 and hash_map.count == 1);
+    hash_map.insert(3, 30);
+    Expect(*hash_map.at(2) == 20 and *hash_map.at(3) == 30 and !hash_map.has(1));
+    Expect(hash_map.extract(2).value == 20 and hash_map.extract(3).value == 30);
+    Expect(hash_map.count == 0 and hash_map.table[0] == NULL);
+}
+
+void regex_large()
+{
+    Test("large");
+
+    // 5000 keywords then a literal every match has
+    Vec<char> source = new_vec<char>(64 << 10);
+    defer(source.deinit());
+    fmt::Vec_Device dev = {};
+    dev.vec = &source;
+    dev.format("{");
+    for (u32 i = 0; i < 5000; i++)
+        dev.format(i == 0 ? "'k%(d:>04)'" : "|'k%(d:>04)'", i);
+    dev.format("} 'end'");
+
+    Engine engines[] = {Engine_Backtrack, Engine_Pike};
+    for (Engine engine : engines) {
+        Regex regex = compile_regex(string{source.data, source.len}, engine);
+        defer(regex.deinit());
+        Expect(regex.match("k0000end").ok and regex.match("k4999end").ok);
+        Expect(!regex.match("k5000end").ok and !regex.match("k4999en").ok);
+        Expect(regex.prefilter.literal == "end" and regex.prefilter.min == 5 and regex.prefilter.max == 5);
+    }
+
+    // nested sequences are read once
+    source.len = 0;
+    for (u32 i = 0; i < 500; i++)
+        dev.format("{ ");
+    dev.format("'x'");
+    for (u32 i = 0; i < 500; i++)
+        dev.format(" }");
+
+    Regex nested = compile_regex(string{source.data, source.len});
+    defer(nested.deinit());
+    Expect(nested.arena.len == 1 and nested.match("x").ok);
+}
+
+void regex_until()
+{
+    Test("until");
+
+    // 'b' is tried at its occurrences only, the rest must still follow it
+    const char *sources[] = {"^ ~ 'ab' 'c'", "n ~ 'ab'", "{'a'|'b'} ~ 'ab' 'x'", "'a' ~ 'a'", "[a-c] ~ 'cd' n"};
+    const char *exprs[] = {"xxabdabc", "12ab", "12a3ab", "babab", "ababx", "aaaa", "abccd1", "abcdcd", ""};
+    for (const char *source : sources) {
+        Regex regex = compile_regex(source);
+        defer(regex.deinit());
+        size_t until = 0;
+        for (size_t i = 0; i < regex.arena.len; i++)
+            until += regex.arena[i].until;
+        Expect(until == 1);
+
+        for (const char *expr : exprs)
+            Match_Engine(Engine_Pike, source, expr);
+    }
+
+    // the comment body is skipped with memchr, not one frame per byte
+    Vec<char> comment = new_vec<char>(1 << 20);
+    defer(comment.deinit());
+    fmt::Vec_Device dev = {};
+    dev.vec = &comment;
+    dev.format("/*");
+    for (u32 i = 0; i < (1 << 16); i++)
+        dev.format(" * x%(d:>04) /", i % 10000);
+    dev.format("*/ int");
+
+    Regex regex = compile_regex("'/*' ^ ~ '*/'");
+    defer(regex.deinit());
+    Match match = regex.match(string{comment.data, comment.len});
+    Expect(match.ok and match.view.len == comment.len - 4);
+    Expect(!regex.match(string{comment.data, comment.len - 6}).ok);
+    Match_Npos("{' '} ~ 'sus'", "            |             sus               ");
+}
+
+void regex_deep()
+{
+    Test("deep");
+
+    // a frame per byte of the line would overflow the thread stack
+    Vec<char> line = new_vec<char>(1 << 20);
+    defer(line.deinit());
+    line.reserve_with(1 << 20, '7');
+    line.len = 1 << 20;
+    string expr = {line.data, line.len};
+
+    const char *sources[] = {"n+", "{!';'}*", "{n|'x'}* n", "{/n ^}+"};
+    for (const char *source : sources) {
+        Regex regex = compile_regex(source);
+        defer(regex.deinit());
+        Expect_Eq(regex.match(expr).view.len, expr.len);
+    }
+
+    // every byte is a choice point, they are all given back before failing
+    Regex regex = compile_regex("n* ';'");
+    defer(regex.deinit());
+    Expect(!regex.match(expr).ok);
+    Expect(regex.match(string{"123;"}).ok);
+}
+
+void regex_glushkov()
+{
+    Test("glushkov");
+
+    // the first alternative that can still end decides, not the longest
+    const char *sources[] = {"^ ~ {'c'|'d'}", "{'a'|'b'} ~ {'c'|'bc'}", "{'a'|'ab'} 'c'?", "{'ab'|'a'} {'bc'|'b'}",
+                             "{a|n}* n", "'a'* 'a'? 'ab'", "{'x'|'xy'}+ 'z'?", "[a-c]+ {'cab'|'c'}"};
+    const char *exprs[] = {"abcabc", "abc", "ac", "abbc", "abc9", "aaab", "xyxz", "xxyz", "cabcab", ""};
+    for (const char *source : sources) {
+        Regex regex = compile_regex(source);
+        defer(regex.deinit());
+        Expect(regex.glushkov.offsets.len != 0);
+
+        for (const char *expr : exprs)
+            Match_Engine(Engine_Pike, source, expr);
+    }
+
+    // 64 positions are the most a thread set holds, each group is one set
+    Vec<char> source = new_vec<char>(1024);
+    defer(source.deinit());
+    fmt::Vec_Device dev = {};
+    dev.vec = &source;
+    for (u32 i = 0; i < 64; i++)
+        dev.format("{'a'|n} ");
+    string wide = {source.data, source.len};
+    dev.format("'x'");
+
+    Regex fits = compile_regex(wide);
+    Regex over = compile_regex(string{source.data, source.len});
+    defer(fits.deinit(); over.deinit());
+    Expect(fits.glushkov.offsets.len != 0 and over.glushkov.offsets.len == 0);
+    Expect(fits.match("a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1x").view.len == 64);
+    Expect(over.match("a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1x").view.len == 65);
+    Expect(!over.match("a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1a1").ok);
+
+    // the live threads of a long input stay in the scratch for the next one
+    Regex crowded = compile_regex("{a|n}* n");
+    Scratch scratch = new_scratch(&crowded);
+    defer(crowded.deinit(); scratch.deinit());
+    char digits[300];
+    memset(digits, '7', sizeof(digits));
+    Expect(crowded.match(string{digits, sizeof(digits)}, &scratch).view.len == sizeof(digits));
+    u64 *lives = scratch.lives.data;
+    Expect(crowded.match(string{digits, sizeof(digits) - 1}, &scratch).view.len == sizeof(digits) - 1);
+    Expect(lives != NULL and scratch.lives.data == lives);
+
+    // lookaround and a literal after '~' stay on the backtracker
+    const char *others[] = {"!'x'* 'x'", "{/n ^}+", "'/*' ^ ~ '*/'"};
+    for (const char *other : others) {
+        Regex regex = compile_regex(other);
+        defer(regex.deinit());
+        Expect(regex.glushkov.offsets.len == 0);
+    }
+}
+
+void regex_keywords()
+{
+    Test("keywords");
+
+    // the branches are one fan-out, in the order they were written
+    Regex flat = compile_regex("{'if'|'else'|'while'|'return'} !a");
+    defer(flat.deinit());
+    Expect(flat.node_head->out.len == 4);
+    Expect(flat.match("while(").ok and !flat.match("whilex").ok);
+
+    // 'k1' comes before 'k10', the byte set and the duplicate keep their rank
+    Vec<char> source = new_vec<char>(8 << 10);
+    defer(source.deinit());
+    fmt::Vec_Device dev = {};
+    dev.vec = &source;
+    dev.format("{");
+    for (u32 i = 0; i < 1000; i++)
+        dev.format("'k%d'|", i);
+    dev.format("'k7'|[x-z]|'zz'} !n");
+    string keywords = {source.data, source.len};
+
+    Regex regex = compile_regex(keywords);
+    defer(regex.deinit());
+    Expect(regex.tries.len == 1);
+
+    const char *exprs[] = {"k1 ", "k10 ", "k999", "k1000", "k7", "zz", "z", "z1", "k", "", "q1"};
+    for (const char *expr : exprs)
+        Match_Engine(Engine_Pike, keywords, expr);
+    Expect(regex.match("k999;").view == "k999;" and !regex.match("k1000").ok);
+
+    // a search only starts where the trie of the head finds a keyword
+    Expect(regex.starts != NULL and !regex.search_pike);
+    const char *haystacks[] = {"xk1 k10 k999;", "k1000 k7z zz1 zz", "kk7 xk12k3 ", "k", ""};
+    for (const char *haystack : haystacks)
+        Match_Engine(Engine_Backtrack, keywords, haystack);
+    Expect_Eq(regex_count(keywords, "k1 k2 k1000 zz", Engine_Backtrack), 3);
+}
+
+// Match and leftmost match with each pass of simplify() alone and with all
+// of them, which must agree
+bool run_passes(const Regex *regex, View<string> inputs, Vec<Match> *out, void *)
+{
+    Vec<Match> first = new_vec<Match>(inputs.len * 2);
+    Vec<Match> matches = new_vec<Match>(inputs.len * 2);
+    defer(first.deinit());
+    defer(matches.deinit());
+
+    const u32 Passes[] = {Pass_Dead, Pass_Eps, Pass_Sets, Pass_Literals, Pass_All};
+    for (u32 passes : Passes) {
+        Config config = new_config();
+        config.passes = passes;
+        Regex simple = compile_regex(regex->source, config);
+        defer(simple.deinit());
+
+        Vec<Match> *it = passes == Pass_Dead ? &first : &matches;
+        it->len = 0;
+        run_match_find(&simple, inputs, it, NULL);
+        if (it != &first and !same_matches(matches, first))
+            return false;
+    }
+    out->concat(first.begin(), first.end());
+    return true;
+}
+
+size_t regex_nodes(string source, u32 passes)
+{
+    Config config = new_config();
+    config.passes = passes;
+    Regex regex = compile_regex(source, config);
+    defer(regex.deinit());
+    return regex.arena.len;
+}
+
+Config no_passes()
+{
+    Config config = new_config();
+    config.passes = 0;
+    return config;
+}
+
+#define Match_Passes(source, expr) \
+    Expect(regex_runner_match(run_passes, run_match_find, no_passes(), source, expr))
+
+void regex_simplify()
+{
+    Test("simplify");
+
+    Match_Passes("'hello' ' ' 'world'", "hello world");
+    Match_Passes("'hello' ' ' 'world'", "hello worl");
+    Match_Passes("{{{'hello'}}}*", "hellohellohell");
+    Match_Passes("{'ab'n}?", "ab");
+    Match_Passes("a{a|'_'|n}*", "snake_case_variable123");
+    Match_Passes("'a' 'b'? 'c'* 'd'", "acccd");
+    Match_Passes("{'cd'|'a'|'b'} n", "c1");
+    Match_Passes("{'cd'|'a'|'b'} n", "b1");
+    Match_Passes("'//' {a|' '} ~ '//'", "// The program starts here // int main() {");
+    Match_Passes("^~/_", "words words");
+    Match_Passes("q {!q ^}* q", "\"a\\\"b\"");
+    Match_Passes("!'x'* 'x'", "abcx");
+    Match_Passes("{'if'|'else'|'while'} !a", "else{");
+    Match_Passes("'ab' {'cd'|'c'} 'e'", "ace");
+    Match_Passes("{'ab' 'cd'}+ 'x'", "abcdabcdx");
+
+    // literals in a row are one node, one byte branches one set
+    Expect(regex_nodes("'hello' ' ' 'world'", 0) == 3 and regex_nodes("'hello' ' ' 'world'", Pass_All) == 1);
+    Expect(regex_nodes("{'cd'|'a'|'b'} n", Pass_Sets) < regex_nodes("{'cd'|'a'|'b'} n", 0));
+    Expect(regex_nodes("'a' 'b'? 'c'* 'd'", Pass_All) < regex_nodes("'a' 'b'? 'c'* 'd'", 0));
+    Expect(regex_nodes("{{{'hello'}}}*", Pass_Eps) < regex_nodes("{{{'hello'}}}*", 0));
+
+    // the keywords keep their trie with a branch that is not a literal after them
+    Vec<char> source = new_vec<char>(256);
+    defer(source.deinit());
+    fmt::Vec_Device dev = {};
+    dev.vec = &source;
+    dev.format("{");
+    for (u32 i = 0; i < 16; i++)
+        dev.format("'k%d'|", i);
+    dev.format("!'q' n} ';'");
+    string keywords = {source.data, source.len};
+
+    Regex regex = compile_regex(keywords);
+    defer(regex.deinit());
+    Expect(regex.tries.len == 1);
+    const char *exprs[] = {"k1;", "k15;", "k16;", "x1;", "q1;", "k;"};
+    for (const char *expr : exprs) {
+        Match_Passes(keywords, expr);
+        Match_Engine(Engine_Pike, keywords, expr);
+    }
+}
+
+// One regex matched by every thread of the pool at once, each thread has a
+// slice of 'matches'
+struct Shared_Job
+{
+    const Regex *regex;
+    View<string> inputs;
+    Match *matches;
+    bool *same;
+};
+
+const u32 Shared_Threads = 8;
+
+void match_shared(void *data, u32 index)
+{
+    auto job = (Shared_Job *)data;
+    Scratch scratch = new_scratch(job->regex);
+    defer(scratch.deinit());
+
+    // the other half run in the scratch of their thread, later rounds find
+    // the matches of the first
+    Scratch *own = index % 2 == 0 ? &scratch : NULL;
+    Match *slice = &job->matches[index * job->inputs.len * 2];
+    bool same = true;
+    for (u32 round = 0; round < 4; round++) {
+        for (size_t i = 0; i < job->inputs.len; i++) {
+            Match match = job->regex->match(job->inputs[i], own);
+            Match found = job->regex->find(job->inputs[i], own);
+            if (round == 0)
+                slice[i * 2] = match, slice[i * 2 + 1] = found;
+            same = same and same_match(match, slice[i * 2]) and same_match(found, slice[i * 2 + 1]);
+        }
+    }
+    job->same[index] = same;
+}
+
+// Match and leftmost match of each input from every thread of the pool in 'ctx'
+bool run_shared(const Regex *regex, View<string> inputs, Vec<Match> *out, void *ctx)
+{
+    size_t len = inputs.len * 2;
+    Vec<Match> matches = new_vec<Match>(len * Shared_Threads);
+    matches.len = len * Shared_Threads;
+    bool same[Shared_Threads] = {};
+    defer(matches.deinit());
+
+    Shared_Job job = {regex, inputs, matches.data, same};
+    ((Thread_Pool *)ctx)->run(Shared_Threads, match_shared, &job);
+    for (size_t i = 0; i < matches.len; i++) {
+        if (!same[i / len] or !same_match(matches[i], matches[i % len]))
+            return false;
+    }
+    out->concat(matches.data, matches.data + len);
+    return true;
+}
+
+#define Match_Shared(engine, source, inputs) \
+    Expect(regex_runner_match_each(run_shared, run_match_find, new_config(engine), source, inputs, pool))
+
+void regex_shared()
+{
+    Test("shared");
+
+    Thread_Pool *pool = new_thread_pool(4);
+    defer(pool->deinit());
+
+    Vec<string> inputs = new_vec<string>(256);
+    defer(inputs.deinit());
+    for (size_t i = 0; i < Lorem_Ipsum.len; i += 7)
+        inputs.push(Lorem_Ipsum.substr(i, Min(Lorem_Ipsum.len - i, (size_t)40)));
+    View<string> view = {inputs.data, inputs.len};
+
+    Engine engines[] = {Engine_Backtrack, Engine_Dfa, Engine_Lazy_Dfa, Engine_Pike};
+    for (Engine engine : engines) {
+        Match_Shared(engine, "a+ _ a+", view);
+        Match_Shared(engine, "^~{'um' | 'em'}", view);
+        Match_Shared(engine, "{a|_}* 'sed' _ {a+ _}? 'eu'", view);
+    }
+    // lookaround and a literal after '~' run on the backtracker and the Pike vm
+    Match_Shared(Engine_Backtrack, "a+ !{a|_}", view);
+    Match_Shared(Engine_Backtrack, "{a|_}* ~ 'elit'", view);
+    Match_Shared(Engine_Pike, "a+ /_ _ !'s'", view);
+}
+
 } // namespace bee
@@ -15,6 +15,29 @@ void regex_or();
 void regex_wave();
 void regex_not();
 void regex_dash();
+void regex_dfa();
+void regex_lazy_dfa();
+void regex_pike();
+void regex_memo();
+void regex_prefilter();
+void regex_find();
+void regex_stream();
+void regex_lexer();
+void regex_static();
+void regex_regen();
+void regex_image();
+void regex_intern();
+void regex_parallel();
+void regex_batch();
+void regex_storage();
+void regex_pool();
+void regex_large();
+void regex_until();
+void regex_deep();
+void regex_glushkov();
+void regex_keywords();
+void regex_simplify();
+void regex_shared();
 
 } // namespace bee
 